@@ -0,0 +1,59 @@
+/*
+  CRIR M1 footprint
+
+  Minimal sketch to measure flash and RAM used by the library with each
+  feature selection (see footprint environments in platformio.ini).
+  Sensor is connected to hardware serial port.
+*/
+
+#include <crir_m1.h>
+
+CRIR_M1 sensor(Serial);
+
+#if CRIR_M1_FEATURE_IDENTITY
+char sn[CRIR_M1_LEN_SN + 1];
+char softver[CRIR_M1_LEN_SOFTVER + 1];
+#endif
+
+volatile int32_t sink;
+
+void setup() {
+    Serial.begin(CRIR_M1_BAUDRATE);
+
+#if CRIR_M1_FEATURE_IDENTITY
+    sensor.get_serial_number(sn);
+    sensor.get_software_version(softver);
+    sink = sensor.get_sensor_type_ID() + sensor.get_sensor_ID() + sensor.get_memory_map_version();
+#endif
+
+#if CRIR_M1_FEATURE_CONFIGURATION
+    sink = sensor.get_ABC_period();
+    sensor.set_ABC_period(180);
+#endif
+
+#if CRIR_M1_FEATURE_CALIBRATION
+    sensor.set_user_concentration(400);
+    sensor.set_user_acknowledgement(CRIR_M1_CLEAR_CALIBRATION_COMPLETION);
+    sensor.set_user_special_command(CRIR_M1_START_USER_CALIBRATION);
+    sink = sensor.get_user_acknowledgement() + sensor.get_user_concentration();
+#endif
+}
+
+void loop() {
+    sink = sensor.get_co2() + sensor.get_temperature();
+
+#if CRIR_M1_FEATURE_DIAGNOSTICS
+    sink = sensor.get_meter_status() + sensor.get_output_status() + sensor.get_PWM_output();
+#endif
+
+#if CRIR_M1_FEATURE_ASYNC
+    if (sensor.request_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR8, 1)) {
+        while (sensor.poll_response() == CRIR_M1_TRANSACTION_PENDING) {
+            yield();
+        }
+        sink = sensor.response_value();
+    }
+#endif
+
+    delay(10000);
+}
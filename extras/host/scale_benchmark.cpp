@@ -0,0 +1,313 @@
+/*******************************************************************
+  CRIR M1 Library - Scale benchmark (host)
+
+Drive a growing number of simulated sensors (CRIR_M1_simulator, answers
+paced at 9600 baud in real time) and report, for each number of sensors:
+
+- samples per second
+- latency percentiles (ms) from request to valid answer
+- timeout rate (requests sent without valid answer)
+- requests refused by the library (link down until next probe)
+- bytes lost by FIFO overrun (receive FIFO of fifo_len bytes, 2 like an AVR
+  USART by default)
+- CPU usage of the process and CPU time per sample
+
+Non-blocking requests are used for all sensors at once, directly and with
+coroutines (only when built as C++20), blocking getters are measured too as
+reference. Loops sleep half a byte time when no request finished in a pass,
+so CPU usage is not the one of a busy loop. Output is CSV so reports of
+different library versions can be compared. Build and run on Linux or macOS:
+
+g++ -std=c++20 -O2 -I../../src scale_benchmark.cpp ../../src/crir_m1.cpp ../../src/crir_m1_sim.cpp ../../src/modbus_crc.cpp -o scale_benchmark
+./scale_benchmark [run_ms] [drop_rate] [fifo_len]
+
+*******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+#include "crir_m1.h"
+#include "crir_m1_sim.h"
+#include "crir_m1_coro.h"
+
+static const uint16_t sensor_counts[] = { 1, 10, 50, 100, 250, 500, 1000, 2000 };
+
+#define RUN_MS             10000      // Default duration of each measure
+#define DROP_RATE          1          // Default percent of requests without answer
+#define FIFO_LEN           2          // Default receive FIFO of simulated UARTs (bytes)
+#define LATENCY_BUCKETS    250        // Latency histogram, 1 ms per bucket (last bucket collects slower answers)
+
+#define MODE_BLOCKING      0          // Blocking getters
+#define MODE_ASYNC         1          // request_registers() and poll_response()
+#define MODE_COROUTINES    2          // Awaitables on CRIR_M1_executor
+
+typedef CRIR_M1T<CRIR_M1_simulator> sim_sensor;
+
+struct endpoint {
+    sim_sensor sensor;
+    unsigned long start_us;
+    bool busy;
+
+    endpoint() : sensor(CRIR_M1_simulator()), start_us(0), busy(false) {}
+};
+
+struct report {
+    uint32_t requests;
+    uint32_t refused;
+    uint32_t samples;
+    uint32_t timeouts;
+    uint32_t overruns;
+    uint32_t histogram[LATENCY_BUCKETS];
+};
+
+static report r;
+static unsigned long run_ms = RUN_MS;
+
+
+/* Time in microseconds */
+static unsigned long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+
+
+/* CPU time of process in microseconds */
+static unsigned long cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+
+
+/* Sleep half a byte time while no answer is complete */
+static void idle() {
+    struct timespec ts = { 0, CRIR_M1_SIM_BYTE_US * 500L };
+    nanosleep(&ts, NULL);
+}
+
+
+/* Save latency of one answer */
+static void add_latency(unsigned long us) {
+    unsigned long ms = us / 1000;
+    r.histogram[(ms < LATENCY_BUCKETS) ? ms : LATENCY_BUCKETS - 1]++;
+}
+
+
+/* Latency percentile in ms */
+static uint16_t percentile(uint8_t p) {
+    uint32_t target = ((uint64_t) r.samples * p + 99) / 100;
+    uint32_t sum = 0;
+
+    for (uint16_t i = 0; i < LATENCY_BUCKETS; i++) {
+        sum += r.histogram[i];
+        if (sum >= target && sum > 0) {
+            return i + 1;
+        }
+    }
+    return LATENCY_BUCKETS;
+}
+
+
+/* Print one line of report */
+static void print_report(const char *mode, uint16_t n, unsigned long elapsed_us, unsigned long cpu) {
+    printf("%s,%s,%u,%.1f,%u,%u,%u,%.2f,%u,%u,%.1f,%.1f\n", CRIR_M1_VERSION, mode, n,
+           r.samples * 1000000.0 / elapsed_us, percentile(50), percentile(90), percentile(99),
+           r.requests ? r.timeouts * 100.0 / r.requests : 0.0, r.refused, r.overruns, cpu * 100.0 / elapsed_us,
+           r.samples ? (double) cpu / r.samples : 0.0);
+    fflush(stdout);
+}
+
+
+/* Measure non-blocking requests on all sensors at once */
+static void run_async(endpoint *e, uint16_t n) {
+    unsigned long start = now_us();
+
+    while (now_us() - start < run_ms * 1000UL) {
+        uint32_t finished = r.samples + r.timeouts;
+
+        for (uint16_t i = 0; i < n; i++) {
+            if (!e[i].busy) {
+                if (e[i].sensor.request_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR8, 1)) {
+                    e[i].busy = true;
+                    e[i].start_us = now_us();
+                    r.requests++;
+                } else {
+                    r.refused++;
+                }
+                continue;
+            }
+
+            uint8_t state = e[i].sensor.poll_response();
+            if (state == CRIR_M1_TRANSACTION_DONE) {
+                add_latency(now_us() - e[i].start_us);
+                r.samples++;
+                e[i].busy = false;
+            } else if (state == CRIR_M1_TRANSACTION_ERROR) {
+                r.timeouts++;
+                e[i].busy = false;
+            }
+        }
+
+        if (r.samples + r.timeouts == finished) {
+            idle();
+        }
+    }
+
+    // Requests still waiting are not counted
+    for (uint16_t i = 0; i < n; i++) {
+        if (e[i].busy) {
+            r.requests--;
+            e[i].busy = false;
+        }
+    }
+}
+
+
+/* Measure blocking getters, one sensor after other */
+static void run_blocking(endpoint *e, uint16_t n) {
+    unsigned long start = now_us();
+    uint16_t i = 0;
+    int16_t co2;
+
+    while (now_us() - start < run_ms * 1000UL) {
+        unsigned long t = now_us();
+        if (e[i].sensor.get_co2(co2) == CRIR_M1_OK) {
+            r.requests++;
+            add_latency(now_us() - t);
+            r.samples++;
+        } else if (e[i].sensor.last_status() == CRIR_M1_ERR_LINK_DOWN) {
+            r.refused++;
+        } else {
+            r.requests++;
+            r.timeouts++;
+        }
+        i = (i + 1) % n;
+    }
+}
+
+
+#ifdef CRIR_M1_COROUTINES
+/* Read CO2 of one sensor until end of measure */
+static CRIR_M1_task read_task(sim_sensor *sensor, unsigned long start) {
+    CRIR_M1_asyncT<CRIR_M1_simulator> async(*sensor);
+
+    while (now_us() - start < run_ms * 1000UL) {
+        unsigned long t = now_us();
+        CRIR_M1_async_result co2 = co_await async.read_co2();
+        r.requests++;
+        if (co2.state == CRIR_M1_TRANSACTION_DONE) {
+            add_latency(now_us() - t);
+            r.samples++;
+        } else {
+            r.timeouts++;
+        }
+    }
+}
+
+
+/* Measure coroutines, one task per sensor, CRIR_M1_EXECUTOR_MAX_TASKS tasks per executor */
+static void run_coroutines(endpoint *e, uint16_t n) {
+    uint16_t n_executors = (n + CRIR_M1_EXECUTOR_MAX_TASKS - 1) / CRIR_M1_EXECUTOR_MAX_TASKS;
+    CRIR_M1_executor *executors = new CRIR_M1_executor[n_executors];
+    unsigned long start = now_us();
+    bool running = true;
+
+    for (uint16_t i = 0; i < n; i++) {
+        executors[i / CRIR_M1_EXECUTOR_MAX_TASKS].spawn(read_task(&e[i].sensor, start));
+    }
+
+    // Tasks still waiting at the end are destroyed, their requests are not counted
+    while (running && now_us() - start < run_ms * 1000UL) {
+        uint32_t finished = r.samples + r.timeouts;
+
+        running = false;
+        for (uint16_t i = 0; i < n_executors; i++) {
+            running |= executors[i].run_once();
+        }
+
+        if (r.samples + r.timeouts == finished) {
+            idle();
+        }
+    }
+
+    delete[] executors;
+}
+#endif
+
+
+/* Create sensors and run one measure */
+static void measure(const char *mode, uint16_t n, uint8_t kind, uint8_t drop_rate, uint8_t fifo_len) {
+    endpoint *e = new (std::nothrow) endpoint[n];
+
+    if (e == NULL) {
+        printf("Not enough memory for %u sensors\n", n);
+        return;
+    }
+
+    memset(&r, 0, sizeof(r));
+    for (uint16_t i = 0; i < n; i++) {
+        e[i].sensor.get_transport().set_co2(400 + i % 1000);
+        e[i].sensor.get_transport().set_drop_rate(drop_rate);
+        e[i].sensor.get_transport().set_fifo_len(fifo_len);
+    }
+
+    unsigned long cpu_start = cpu_us();
+    unsigned long start = now_us();
+
+    switch (kind) {
+        case MODE_BLOCKING:
+            run_blocking(e, n);
+            break;
+        case MODE_ASYNC:
+            run_async(e, n);
+            break;
+#ifdef CRIR_M1_COROUTINES
+        case MODE_COROUTINES:
+            run_coroutines(e, n);
+            break;
+#endif
+    }
+
+    unsigned long elapsed = now_us() - start;
+    unsigned long cpu = cpu_us() - cpu_start;
+
+    for (uint16_t i = 0; i < n; i++) {
+        r.overruns += e[i].sensor.get_transport().overruns();
+    }
+
+    print_report(mode, n, elapsed, cpu);
+    delete[] e;
+}
+
+
+int main(int argc, char **argv) {
+
+    uint8_t drop_rate = DROP_RATE;
+    uint8_t fifo_len = FIFO_LEN;
+
+    if (argc > 1) {
+        run_ms = atol(argv[1]);
+    }
+    if (argc > 2) {
+        drop_rate = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        fifo_len = atoi(argv[3]);
+    }
+
+    printf("version,mode,sensors,samples_per_s,p50_ms,p90_ms,p99_ms,timeout_pct,refused,overrun_bytes,cpu_pct,cpu_us_per_sample\n");
+
+    measure("blocking", 1, MODE_BLOCKING, drop_rate, fifo_len);
+    for (uint8_t i = 0; i < sizeof(sensor_counts) / sizeof(sensor_counts[0]); i++) {
+        measure("async", sensor_counts[i], MODE_ASYNC, drop_rate, fifo_len);
+    }
+#ifdef CRIR_M1_COROUTINES
+    for (uint8_t i = 0; i < sizeof(sensor_counts) / sizeof(sensor_counts[0]); i++) {
+        measure("coroutine", sensor_counts[i], MODE_COROUTINES, drop_rate, fifo_len);
+    }
+#endif
+
+    return 0;
+}
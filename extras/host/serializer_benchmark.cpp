@@ -0,0 +1,68 @@
+/*******************************************************************
+  CRIR M1 Library - Serializer benchmark (host)
+
+Bytes written per microsecond by CRIR_M1_serializer for each format, with
+one snapshot and with a history of HISTORY_LEN samples. Build and run:
+
+g++ -std=c++17 -O2 -I../../src serializer_benchmark.cpp ../../src/crir_m1.cpp ../../src/crir_m1_serializer.cpp ../../src/modbus_crc.cpp -o serializer_benchmark
+./serializer_benchmark [iterations]
+
+*******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "crir_m1_serializer.h"
+
+#define HISTORY_LEN  96                                                  // Samples of a day every 15 minutes
+
+static const char *format_name[] = { "csv", "json", "cbor" };
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Write snapshot or history many times, returns bytes written per microsecond (0 on overflow)
+static double run(uint8_t format, bool history, long iterations, const CRIR_M1_sensor &sensor, const CRIR_M1_sample *samples, size_t &bytes) {
+    static uint8_t buf[8192];
+    CRIR_M1_serializer ser(buf, sizeof(buf));
+    double total = 0;
+
+    double start = now_us();
+    for (long i = 0; i < iterations; i++) {
+        ser.reset();
+        bytes = history ? ser.write_history(samples, HISTORY_LEN, format) : ser.write_snapshot(sensor, format);
+        if (bytes == 0) {
+            return 0;
+        }
+        total += bytes;
+    }
+    return total / (now_us() - start);
+}
+
+
+int main(int argc, char **argv) {
+
+    long iterations = (argc > 1) ? atol(argv[1]) : 200000L;
+    CRIR_M1_sensor sensor = { "A1B2C3D4E5", "1.2.3", 812, 23 };
+    CRIR_M1_sample samples[HISTORY_LEN];
+    size_t bytes;
+
+    for (uint16_t i = 0; i < HISTORY_LEN; i++) {
+        samples[i].timestamp = 1700000000UL + i * 900UL;
+        samples[i].co2 = 400 + (i * 37) % 1600;
+        samples[i].temperature = 15 + i % 15;
+    }
+
+    printf("format,record,bytes,bytes_per_us\n");
+    for (uint8_t format = CRIR_M1_FORMAT_CSV; format <= CRIR_M1_FORMAT_CBOR; format++) {
+        double rate = run(format, false, iterations, sensor, samples, bytes);
+        printf("%s,snapshot,%u,%.1f\n", format_name[format], (unsigned) bytes, rate);
+        rate = run(format, true, iterations / HISTORY_LEN + 1, sensor, samples, bytes);
+        printf("%s,history,%u,%.1f\n", format_name[format], (unsigned) bytes, rate);
+    }
+
+    return 0;
+}
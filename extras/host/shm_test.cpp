@@ -0,0 +1,188 @@
+/*******************************************************************
+  CRIR M1 Library - Shared memory test (host)
+
+One publisher writes readings as fast as possible while READERS forked
+processes read them. All values of a reading are derived from a counter,
+so a reader detects a torn slot (values of two different readings). Then
+the publisher opens the segment with another number of slots and old and
+new readers are checked, and a slot left half written by a stopped
+publisher is checked. Exits with 1 on failure. Build and run on Linux:
+
+g++ -std=c++17 -O2 -I../../src shm_test.cpp ../../src/crir_m1.cpp ../../src/crir_m1_shm.cpp ../../src/modbus_crc.cpp -o shm_test -lrt
+./shm_test [readers] [run_ms]
+
+*******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "crir_m1_shm.h"
+
+#define SEGMENT   "/crir_m1_shm_test"
+#define SLOTS     8
+#define READERS   4
+#define RUN_MS    2000
+
+static int failures = 0;
+
+
+/* Time in milliseconds */
+static unsigned long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+
+/* Show result of a check */
+static void check(bool ok, const char *what) {
+    printf("%s: %s\n", ok ? "OK" : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+
+/* Reading number n of a slot */
+static CRIR_M1_shm_reading make_reading(uint32_t slot, uint32_t n) {
+    CRIR_M1_shm_reading r = {};
+    r.sensor_id = slot;
+    r.timestamp = n;
+    r.co2 = n & 0x7FFF;
+    r.temperature = (n >> 3) & 0x7FFF;
+    r.meter_status = ~n & 0x7FFF;
+    r.output_status = (n * 7) & 0x7FFF;
+    r.status = n & 0xFF;
+    r.link = (n >> 8) & 0xFF;
+    r.reserved = (n >> 16) & 0xFFFF;
+    return r;
+}
+
+
+/* Values of a reading belong to the same write */
+static bool consistent(uint32_t slot, const CRIR_M1_shm_reading &r) {
+    CRIR_M1_shm_reading expected = make_reading(slot, r.timestamp);
+    return memcmp(&r, &expected, sizeof(r)) == 0;
+}
+
+
+/* Reader process, exit code 0 if all readings were consistent */
+static int reader(unsigned long run_ms) {
+    CRIR_M1_shm_reader sub;
+    CRIR_M1_shm_reading r;
+    unsigned long reads = 0;
+    unsigned long torn = 0;
+
+    if (!sub.open(SEGMENT)) {
+        printf("Reader %d: cannot open segment\n", getpid());
+        return 1;
+    }
+
+    unsigned long start = now_ms();
+    while (now_ms() - start < run_ms) {
+        for (uint32_t slot = 0; slot < sub.slots(); slot++) {
+            if (sub.read(slot, r)) {
+                reads++;
+                if (!consistent(slot, r)) {
+                    torn++;
+                }
+            }
+        }
+    }
+
+    printf("Reader %d: %lu reads, %lu torn\n", getpid(), reads, torn);
+    fflush(stdout);
+    return (torn == 0 && reads > 0) ? 0 : 1;
+}
+
+
+int main(int argc, char **argv) {
+
+    int n_readers = (argc > 1) ? atoi(argv[1]) : READERS;
+    unsigned long run_ms = (argc > 2) ? atol(argv[2]) : RUN_MS;
+    CRIR_M1_shm_publisher pub;
+    CRIR_M1_shm_reading r;
+    pid_t pids[64];
+
+    if (n_readers < 1 || n_readers > 64) {
+        n_readers = READERS;
+    }
+
+    CRIR_M1_shm_publisher::remove(SEGMENT);
+    check(pub.open(SEGMENT, SLOTS), "publisher opens segment");
+
+    CRIR_M1_shm_publisher other;
+    check(!other.open(SEGMENT, SLOTS), "second publisher is refused");
+
+    for (uint32_t slot = 0; slot < SLOTS; slot++) {
+        pub.publish(slot, make_reading(slot, 0));
+    }
+
+    // Readers against a publisher writing all the time
+    fflush(stdout);
+    for (int i = 0; i < n_readers; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            _exit(reader(run_ms));
+        }
+    }
+
+    uint32_t n = 1;
+    int running = n_readers;
+    while (running > 0) {
+        for (uint32_t slot = 0; slot < SLOTS; slot++) {
+            pub.publish(slot, make_reading(slot, n));
+        }
+        n++;
+        int status;
+        if ((n & 0xFFF) == 0 && waitpid(-1, &status, WNOHANG) > 0) {
+            check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "reader saw no torn slot");
+            running--;
+        }
+    }
+    printf("Publisher: %lu writes\n", (unsigned long) n * SLOTS);
+
+    // Layout change, old reader sees old segment is stale
+    CRIR_M1_shm_reader old_sub;
+    check(old_sub.open(SEGMENT) && old_sub.slots() == SLOTS, "reader opens segment");
+    check(pub.open(SEGMENT, SLOTS * 2), "publisher opens segment with more slots");
+    pub.publish(SLOTS * 2 - 1, make_reading(SLOTS * 2 - 1, 42));
+    check(old_sub.slots() == SLOTS && !old_sub.read(SLOTS * 2 - 1, r), "old reader keeps its number of slots");
+    check(old_sub.stale() && !old_sub.read(0, r), "old reader sees segment was replaced");
+
+    CRIR_M1_shm_reader new_sub;
+    check(new_sub.open(SEGMENT) && new_sub.slots() == SLOTS * 2, "new reader sees new number of slots");
+    check(new_sub.read(SLOTS * 2 - 1, r) && r.timestamp == 42, "new reader reads new slot");
+    check(!new_sub.read(0, r), "new segment starts empty");
+
+    // Same layout, values are kept
+    pub.publish(0, make_reading(0, 7));
+    check(pub.open(SEGMENT, SLOTS * 2) && new_sub.read(0, r) && r.timestamp == 7 && !new_sub.stale(), "publisher reopens segment keeping values");
+
+    // Publisher stopped while writing slot 1, next one must not publish torn values
+    pub.publish(1, make_reading(1, 9));
+    pub.close();
+    int fd = shm_open(SEGMENT, O_RDWR, 0);
+    void *p = (fd >= 0) ? mmap(NULL, sizeof(CRIR_M1_shm_header) + 2 * sizeof(CRIR_M1_shm_slot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (p != MAP_FAILED) {
+        CRIR_M1_shm_slot *half = (CRIR_M1_shm_slot *) ((uint8_t *) p + sizeof(CRIR_M1_shm_header)) + 1;
+        half->seq++;
+        half->words[0] = 0xDEADBEEF;
+        munmap(p, sizeof(CRIR_M1_shm_header) + 2 * sizeof(CRIR_M1_shm_slot));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    check(pub.open(SEGMENT, SLOTS * 2) && !new_sub.read(1, r) && new_sub.read(0, r), "half written slot is cleared on reopen");
+    pub.publish(1, make_reading(1, 10));
+    check(new_sub.read(1, r) && consistent(1, r) && r.timestamp == 10, "cleared slot is published again");
+
+    pub.close();
+    CRIR_M1_shm_publisher::remove(SEGMENT);
+    check(new_sub.stale() && !new_sub.read(0, r), "reader sees segment was removed");
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/*******************************************************************
+  CRIR M1 Library - Transport benchmark (host)
+
+Time per byte of get_co2(co2) with the sensor behind:
+
+virtual    -> abstract byte stream with virtual calls, like Arduino Stream before transports
+template   -> CRIR_M1_buffer_transport, calls resolved at compile time
+
+Both read the same answers from memory, so only the cost of the library
+and the calls to the transport is measured. One answer is given for each
+request, so periodic meter status reads are disabled. Build and run on
+Linux or macOS:
+
+g++ -std=c++17 -O2 -DCRIR_M1_METER_CHECK_EVERY=0 -I../../src transport_benchmark.cpp ../../src/crir_m1.cpp ../../src/modbus_crc.cpp -o transport_benchmark
+./transport_benchmark [transactions]
+
+*******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "crir_m1.h"
+#include "modbus_crc.h"
+
+#define ANSWER_LEN  7                                                    // Answer to read one input register
+#define REQUEST_LEN 8                                                    // Request to read one input register
+
+
+// Abstract byte stream, like Arduino Stream
+class byte_stream
+{
+    public:
+        virtual ~byte_stream() {}
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual size_t write(const uint8_t *data, size_t size) = 0;
+        virtual void flush() = 0;
+};
+
+// Byte stream in memory
+class buffer_stream : public byte_stream
+{
+    public:
+        CRIR_M1_buffer_transport buf;
+
+        int available() override { return buf.available(); }
+        int read() override { return buf.read(); }
+        size_t write(const uint8_t *data, size_t size) override { buf.write(data, size); return size; }
+        void flush() override {}
+};
+
+// Transport calling a byte stream through virtual functions
+class virtual_transport
+{
+    public:
+        virtual_transport(byte_stream &stream) : stream(&stream), ms(0) {}
+
+        int available() { return stream->available(); }
+        int read() { return stream->read(); }
+        void write(const uint8_t *data, uint8_t size) { stream->write(data, size); }
+        void flush() { stream->flush(); }
+        void wait(unsigned long ms) { (void) ms; }
+        unsigned long now_ms() { return ms++; }
+
+    private:
+        byte_stream *stream;
+        unsigned long ms;
+};
+
+
+// Answer of sensor to a CO2 request
+static void make_answer(uint8_t *answer, int16_t co2) {
+    answer[0] = MODBUS_ANY_ADDRESS;
+    answer[1] = MODBUS_FUNC_READ_INPUT_REGISTERS;
+    answer[2] = 2;
+    answer[3] = co2 >> 8;
+    answer[4] = co2 & 0xFF;
+    unsigned short crc = modbus_CRC16(answer, 5);
+    answer[5] = crc & 0xFF;
+    answer[6] = crc >> 8;
+}
+
+// Stream created out of sight of the compiler, so calls stay virtual
+__attribute__((noinline)) static byte_stream *new_stream() {
+    return new buffer_stream();
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Run transactions, returns ns per byte sent and received (0 if a transaction failed)
+template <class Transport>
+static double run(CRIR_M1T<Transport> &sensor, CRIR_M1_buffer_transport &buf, const uint8_t *answer, long transactions) {
+    int16_t co2;
+    double start = now_ns();
+    for (long i = 0; i < transactions; i++) {
+        buf.clear_sent();
+        buf.feed(answer, ANSWER_LEN);
+        if (sensor.get_co2(co2) != CRIR_M1_OK) {
+            return 0;
+        }
+    }
+    return (now_ns() - start) / (transactions * (double) (ANSWER_LEN + REQUEST_LEN));
+}
+
+
+int main(int argc, char **argv) {
+
+    long transactions = (argc > 1) ? atol(argv[1]) : 1000000L;
+    uint8_t answer[ANSWER_LEN];
+    make_answer(answer, 800);
+
+    byte_stream *stream = new_stream();
+    CRIR_M1_buffer_transport &stream_buf = static_cast<buffer_stream *>(stream)->buf;
+    CRIR_M1T<virtual_transport> before{virtual_transport(*stream)};
+    CRIR_M1T<CRIR_M1_buffer_transport> after{CRIR_M1_buffer_transport()};
+
+    // Warm up
+    run(before, stream_buf, answer, transactions / 10);
+    run(after, after.get_transport(), answer, transactions / 10);
+
+    double ns_before = run(before, stream_buf, answer, transactions);
+    double ns_after = run(after, after.get_transport(), answer, transactions);
+    if (ns_before == 0 || ns_after == 0) {
+        printf("Transaction failed\n");
+        return 1;
+    }
+
+    printf("transport,transactions,ns_per_byte\n");
+    printf("virtual,%ld,%.2f\n", transactions, ns_before);
+    printf("template,%ld,%.2f\n", transactions, ns_after);
+    delete stream;
+    return 0;
+}
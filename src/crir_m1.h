@@ -48,18 +48,85 @@ Answer:
 #ifndef _CRIR_M1
     #define _CRIR_M1
 
-    #if defined ARDUINO_ARCH_SAMD || defined ARDUINO_ARCH_SAM21D || defined ARDUINO_ARCH_ESP32 || defined ARDUINO_SAM_DUE || ARDUINO_ARCH_APOLLO3
+    #if defined ARDUINO_ARCH_SAMD || defined ARDUINO_ARCH_SAM21D || defined ARDUINO_ARCH_ESP32 || defined ARDUINO_SAM_DUE || ARDUINO_ARCH_APOLLO3 || !defined ARDUINO
         #undef USE_SOFTWARE_SERIAL
     #else
         #define USE_SOFTWARE_SERIAL
     #endif
 
-    #include "Arduino.h"
+    #ifdef ARDUINO
+        #include "Arduino.h"
+    #else
+        #include <stdint.h>
+        #include <stdio.h>
+        #include <string.h>
+    #endif
 
-    #ifdef USE_SOFTWARE_SERIAL       
+    // Define CRIR_M1_NO_SOFTWARE_SERIAL if sketch does not use SoftwareSerial (saves flash and RAM on AVR)
+    #if defined USE_SOFTWARE_SERIAL && !defined CRIR_M1_NO_SOFTWARE_SERIAL
         #include <SoftwareSerial.h>
     #endif
 
+
+    /* Features, set to 0 to remove from build */
+
+    #ifndef CRIR_M1_FEATURE_IDENTITY
+        #define CRIR_M1_FEATURE_IDENTITY       (1)    // Serial number, software version, sensor IDs and memory map version
+    #endif
+
+    #ifndef CRIR_M1_FEATURE_CONFIGURATION
+        #define CRIR_M1_FEATURE_CONFIGURATION  (1)    // ABC period
+    #endif
+
+    #ifndef CRIR_M1_FEATURE_CALIBRATION
+        #define CRIR_M1_FEATURE_CALIBRATION    (1)    // User concentration, acknowledgement and special command
+    #endif
+
+    #ifndef CRIR_M1_FEATURE_DIAGNOSTICS
+        #define CRIR_M1_FEATURE_DIAGNOSTICS    (1)    // Meter status, output status and PWM output
+    #endif
+
+    #ifndef CRIR_M1_FEATURE_ASYNC
+        #define CRIR_M1_FEATURE_ASYNC          (1)    // Non-blocking requests
+    #endif
+
+    #ifndef CRIR_M1_FEATURE_HEALTH
+        #define CRIR_M1_FEATURE_HEALTH         (1)    // Link monitor, probes and recovery
+    #endif
+
+    // Set to 1 so all instances use one transaction buffer (blocking API only, not thread safe)
+    #ifndef CRIR_M1_SHARED_BUFFER
+        #define CRIR_M1_SHARED_BUFFER          (0)
+    #endif
+
+    #if CRIR_M1_SHARED_BUFFER && CRIR_M1_FEATURE_ASYNC
+        #error "CRIR_M1_SHARED_BUFFER needs CRIR_M1_FEATURE_ASYNC set to 0"
+    #endif
+
+    // CRIR_M1_FEATURE_ASYNC, CRIR_M1_FEATURE_HEALTH and CRIR_M1_SHARED_BUFFER change
+    // the members of CRIR_M1T, so they must have the same value in all files (build
+    // flags, not #define in a sketch). CRIR_M1T is in an inline namespace named after
+    // them: a file compiled with other values fails to link (undefined reference to
+    // crir_m1_layout_...::CRIR_M1T) instead of using sensors with another layout.
+    #if CRIR_M1_FEATURE_ASYNC
+        #define CRIR_M1_LAYOUT_ASYNC   1
+    #else
+        #define CRIR_M1_LAYOUT_ASYNC   0
+    #endif
+    #if CRIR_M1_FEATURE_HEALTH
+        #define CRIR_M1_LAYOUT_HEALTH  1
+    #else
+        #define CRIR_M1_LAYOUT_HEALTH  0
+    #endif
+    #if CRIR_M1_SHARED_BUFFER
+        #define CRIR_M1_LAYOUT_SHARED  1
+    #else
+        #define CRIR_M1_LAYOUT_SHARED  0
+    #endif
+    #define CRIR_M1_LAYOUT_CAT(x, y, z)   crir_m1_layout_a##x##_h##y##_s##z
+    #define CRIR_M1_LAYOUT_NAME(x, y, z)  CRIR_M1_LAYOUT_CAT(x, y, z)
+    #define CRIR_M1_LAYOUT  CRIR_M1_LAYOUT_NAME(CRIR_M1_LAYOUT_ASYNC, CRIR_M1_LAYOUT_HEALTH, CRIR_M1_LAYOUT_SHARED)
+
     #define CRIR_M1_LOG_LEVEL_NONE       (0)
     #define CRIR_M1_LOG_LEVEL_ERROR      (1)
     #define CRIR_M1_LOG_LEVEL_WARN       (2)
@@ -85,20 +152,29 @@ Answer:
             /* Modify if you use softwareserial for debug */
             #define CRIR_M1_DEBUG_SERIAL_RX 13
             #define CRIR_M1_DEBUG_SERIAL_TX 15
+            extern SoftwareSerial CRIR_M1_DEBUG_SERIAL;
         #else
             /* Modify if you use hardware serial for debug */
             #define CRIR_M1_DEBUG_SERIAL Serial
         #endif
 
         /* Debug format */
-        #define CRIR_M1_LOG(format, ...) CRIR_M1_DEBUG_SERIAL.printf(format, ##__VA_ARGS__)
+        #ifdef ARDUINO
+            #define CRIR_M1_LOG(format, ...) CRIR_M1_DEBUG_SERIAL.printf(format, ##__VA_ARGS__)
+        #else
+            #define CRIR_M1_LOG(format, ...) printf(format, ##__VA_ARGS__)
+        #endif
     #else
         #define CRIR_M1_LOG(format, ...)
     #endif
 
 
+    #define CRIR_M1_VERSION  "1.0.0"      // Library version
+
     #define CRIR_M1_BAUDRATE 9600         // Device to CRIR M1 Serial baudrate (should not be changed)
     #define CRIR_M1_TIMEOUT  5            // Timeout for communication
+    #define CRIR_M1_TIMEOUT_MS  (CRIR_M1_TIMEOUT * 1000UL)   // Timeout for non-blocking requests in milliseconds
+    #define CRIR_M1_BYTE_TIMEOUT_MS  1000UL                  // Max time between bytes of an answer in milliseconds
     #define CRIR_M1_LEN_BUF_MSG  20       // Max length of buffer for communication with the sensor
 
     #define CRIR_M1_LEN_SN       10       // Length of serial number
@@ -154,6 +230,36 @@ Answer:
     #define CRIR_M1_CALIBRATION_COMPLETED          0x0001   // Calibration completed
 
 
+    // Transaction state of non-blocking requests
+    #define CRIR_M1_TRANSACTION_IDLE               (0)      // No request sent
+    #define CRIR_M1_TRANSACTION_PENDING            (1)      // Waiting answer of sensor
+    #define CRIR_M1_TRANSACTION_DONE               (2)      // Valid answer received
+    #define CRIR_M1_TRANSACTION_ERROR              (3)      // Invalid answer or timeout
+
+
+    // Status of requests
+    #define CRIR_M1_OK                             (0)      // Valid answer
+    #define CRIR_M1_ERR_TIMEOUT                    (1)      // No answer
+    #define CRIR_M1_ERR_RESPONSE                   (2)      // Invalid answer (length, checksum...)
+    #define CRIR_M1_ERR_METER                      (3)      // Sensor reports memory error
+    #define CRIR_M1_ERR_LINK_DOWN                  (4)      // Link is down, request not sent until next probe
+    #define CRIR_M1_ERR_BUSY                       (5)      // Non-blocking request pending, blocking request not sent
+
+
+    // Link state
+    #define CRIR_M1_LINK_HEALTHY                   (0)      // Last request was valid
+    #define CRIR_M1_LINK_DEGRADED                  (1)      // Some requests failed or CO2 is out of range
+    #define CRIR_M1_LINK_DOWN                      (2)      // Too many requests failed or memory error
+
+    #define CRIR_M1_DOWN_FAILURES  3          // Consecutive failures to consider link down
+    #define CRIR_M1_PROBE_MIN_MS   1000UL     // First probe of a down link (ms)
+    #define CRIR_M1_PROBE_MAX_MS   60000UL    // Max time between probes of a down link (ms)
+
+    #ifndef CRIR_M1_METER_CHECK_EVERY
+        #define CRIR_M1_METER_CHECK_EVERY  50     // Blocking requests between meter status reads (1 - 255, 0 to disable)
+    #endif
+
+
     struct CRIR_M1_sensor {
         char sn[CRIR_M1_LEN_SN + 1];
         char softver[CRIR_M1_LEN_SOFTVER + 1];
@@ -161,39 +267,129 @@ Answer:
         int16_t temperature;
     };
 
-    class CRIR_M1
+    struct CRIR_M1_sample {
+        uint32_t timestamp;                                                  // Time of reading (seconds)
+        int16_t co2;                                                         // CO2 value in ppm
+        int16_t temperature;                                                 // Temperature in celsius degree
+    };
+
+    #include "crir_m1_transport.h"
+
+    inline namespace CRIR_M1_LAYOUT {
+
+    // Sensor on a transport, see crir_m1_transport.h
+    template <class Transport>
+    class CRIR_M1T
     {
         public:
-            CRIR_M1(Stream &serial);                                             // Initialize
-            void get_serial_number(char sn[]);                                   // Get serial number
-            void get_software_version(char softver[]);                           // Get software version
+            CRIR_M1T(const Transport &transport);                                // Initialize
+            Transport &get_transport() { return transport; }                     // Get transport used to talk with the sensor
             int16_t get_co2();                                                   // Get CO2 value in ppm
+            uint8_t get_co2(int16_t &co2);                                       // Get CO2 value in ppm, returns status
             int16_t get_temperature();                                           // Get detector temperature in celsius degree
+            uint8_t get_temperature(int16_t &temperature);                       // Get detector temperature in celsius degree, returns status
+            uint8_t last_status();                                               // Get status of last request
+            uint8_t link_state();                                                // Get link state
+            uint8_t failures();                                                  // Get consecutive failed requests
+#if CRIR_M1_FEATURE_HEALTH
+            uint8_t check_link();                                                // Probe a down link when it is time, returns link state
+#endif
+#if CRIR_M1_FEATURE_IDENTITY
+            void get_serial_number(char sn[]);                                   // Get serial number
+            void get_software_version(char softver[]);                           // Get software version
+            int32_t get_sensor_type_ID();                                        // Get sensor type ID
+            int32_t get_sensor_ID();                                             // Get sensor ID
+            int16_t get_memory_map_version();                                    // Get memory map version
+#endif
+#if CRIR_M1_FEATURE_CONFIGURATION
             int16_t get_ABC_period();                                            // Get ABC period in hours
             bool set_ABC_period(int16_t period);                                 // Set ABC period (4 - 4800 hours, 0 to disable)
+#endif
+#if CRIR_M1_FEATURE_CALIBRATION
             int16_t get_user_concentration();                                    // Get user concentration in ppm
             bool set_user_concentration(int16_t concentration);                  // Set user concentration in ppm
             int16_t get_user_acknowledgement();                                  // Get user acknowledgement
             bool set_user_acknowledgement(int16_t flag);                         // Set user acknowledgement
             bool set_user_special_command(int16_t command);                      // Set user special command
+#endif
+#if CRIR_M1_FEATURE_DIAGNOSTICS
             int16_t get_meter_status();                                          // Get meter status
+            uint8_t get_meter_status(int16_t &meter);                            // Get meter status, returns status of request
             int16_t get_output_status();                                         // Get output status
+            uint8_t get_output_status(int16_t &output);                          // Get output status, returns status of request
             int16_t get_PWM_output();                                            // Get PWM output
-            int32_t get_sensor_type_ID();                                        // Get sensor type ID
-            int32_t get_sensor_ID();                                             // Get sensor ID
-            int16_t get_memory_map_version();                                    // Get memory map version
+#endif
+#if CRIR_M1_FEATURE_ASYNC
+            bool request_registers(uint8_t func, uint16_t reg, uint16_t words);  // Send read request without waiting answer
+            uint8_t poll_response();                                             // Collect answer bytes without blocking, returns transaction state
+            int32_t response_value();                                            // Get value of last completed request (1 or 2 words)
+#endif
 
         private:
-            Stream* mySerial;                                                    // Communication serial with the sensor
+            Transport transport;                                                 // Communication with the sensor
+#if CRIR_M1_SHARED_BUFFER
+            static uint8_t buf_msg[CRIR_M1_LEN_BUF_MSG];                         // Buffer for communication messages shared by all sensors
+#else
             uint8_t buf_msg[CRIR_M1_LEN_BUF_MSG];                                // Buffer for communication messages with the sensor
+#endif
+#if CRIR_M1_FEATURE_ASYNC
+            uint8_t rx_state;                                                    // Transaction state of non-blocking request
+            uint8_t rx_func;                                                     // Function code of non-blocking request
+            uint8_t rx_expected;                                                 // Expected length of answer
+            uint8_t rx_count;                                                    // Bytes received of answer
+            unsigned long rx_start;                                              // Time when request was sent (ms)
+#if CRIR_M1_FEATURE_HEALTH
+            bool rx_probe;                                                       // Non-blocking request is a probe of a down link
+#endif
+#endif
+            uint8_t status;                                                      // Status of last request
+            uint8_t link;                                                        // Link state
+            uint8_t n_failures;                                                  // Consecutive failed requests
+            int16_t meter_bits;                                                  // Out of range and memory error bits of last meter status
+#if CRIR_M1_FEATURE_HEALTH
+            unsigned long probe_at;                                              // Time of next probe of a down link (ms)
+            unsigned long probe_interval;                                        // Time between probes (ms)
+            bool abc_saved;                                                      // ABC period was set
+            int16_t abc_period;                                                  // ABC period set
+            bool concentration_saved;                                            // User concentration was set
+            int16_t user_concentration;                                          // User concentration set
+            bool config_pending;                                                 // Configuration must be sent again after recovery
+            uint8_t meter_countdown;                                             // Blocking requests until next meter status read
+#endif
 
             void serial_write_bytes(uint8_t size);                               // Send bytes to sensor
             uint8_t serial_read_bytes(uint8_t max_bytes, int timeout_seconds);   // Read received bytes from sensor
             bool valid_response(uint8_t func, uint8_t nb);                       // Check if response is valid according to sent command
             bool valid_response_len(uint8_t func, uint8_t nb, uint8_t len);      // Check if response is valid according to sent command and checking expected total length
             void send_cmd(uint8_t func, uint16_t cmd, uint16_t value);           // Send command
+            uint8_t transaction(uint8_t func, uint16_t reg, uint16_t words);     // Send read request and wait answer, returns status
+            uint8_t read_registers(uint8_t func, uint16_t reg, uint16_t words);  // Read registers checking link state, returns status
+            void update_health(uint8_t result);                                  // Update link state with status of a request
+            void check_meter(int16_t meter_status);                              // Update link state with meter status
+            void set_link_down();                                                // Set link down and schedule first probe
+#if CRIR_M1_FEATURE_HEALTH
+            void recover();                                                      // Clear state after link is up, configuration is sent later
+            void restore_config();                                               // Send configuration again after recovery (blocking)
+            void poll_meter();                                                   // Read meter status every CRIR_M1_METER_CHECK_EVERY requests
+            void next_probe();                                                   // Wait longer for next probe
+#endif
+#if CRIR_M1_FEATURE_CONFIGURATION || CRIR_M1_FEATURE_CALIBRATION
+            bool write_register(uint16_t reg, int16_t value);                    // Preset single register and check echo of the sensor
+#endif
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)
             void print_buffer(uint8_t size);                                     // Show buffer in hex bytes
             void print_binary(int16_t number);                                   // Show number in bits
+#endif
     };
 
+    }
+
+    #include "crir_m1_impl.h"
+
+    #ifdef ARDUINO
+    // Sensor on an Arduino Stream (HardwareSerial, SoftwareSerial...), compiled once in crir_m1.cpp
+    typedef CRIR_M1T<CRIR_M1_stream_transport> CRIR_M1;
+    extern template class CRIR_M1T<CRIR_M1_stream_transport>;
+    #endif
+
 #endif
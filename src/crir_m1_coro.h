@@ -0,0 +1,303 @@
+/*******************************************************************
+  CRIR M1 Library - Coroutines
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+C++20 awaitables on top of non-blocking requests of CRIR_M1.
+Only available when the toolchain supports coroutines and
+CRIR_M1_FEATURE_ASYNC is enabled (CRIR_M1_COROUTINES is defined), otherwise
+this header is empty.
+
+Example:
+
+CRIR_M1_task poll_sensor(CRIR_M1_async sensor) {
+    for (;;) {
+        CRIR_M1_async_result co2 = co_await sensor.read_co2();
+        if (co2.state == CRIR_M1_TRANSACTION_DONE) {
+            ...
+        }
+    }
+}
+
+CRIR_M1_executor executor;
+executor.spawn(poll_sensor(CRIR_M1_async(sensor1)));
+executor.spawn(poll_sensor(CRIR_M1_async(sensor2)));
+executor.set_idle(idle);             // Optional, called when no answer is complete
+executor.run();
+
+Sensors on other transports use CRIR_M1_asyncT<Transport>.
+
+Only one task should use a sensor at the same time. While the link is down
+(or the sensor is busy), the task waits in the executor until the request can
+be sent, the request sent when the probe is due works as probe.
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_CORO
+    #define _CRIR_M1_CORO
+
+    #include "crir_m1.h"
+
+    #if defined(__has_include) && CRIR_M1_FEATURE_ASYNC
+        #if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+            #define CRIR_M1_COROUTINES
+        #endif
+    #endif
+
+    #ifdef CRIR_M1_COROUTINES
+
+    #include <coroutine>
+    #include <exception>
+
+    #ifndef CRIR_M1_EXECUTOR_MAX_TASKS
+        #define CRIR_M1_EXECUTOR_MAX_TASKS  32    // Max tasks running in one executor
+    #endif
+
+
+    class CRIR_M1_executor;
+
+    // Result of an awaited request
+    struct CRIR_M1_async_result {
+        uint8_t state;                                                       // CRIR_M1_TRANSACTION_DONE or CRIR_M1_TRANSACTION_ERROR
+        int32_t value;                                                       // Value, only valid if state is done
+    };
+
+
+    // Coroutine handled by CRIR_M1_executor
+    class CRIR_M1_task
+    {
+        public:
+            struct promise_type {
+                CRIR_M1_executor *executor = nullptr;
+
+                CRIR_M1_task get_return_object() { return CRIR_M1_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                std::suspend_always final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+
+            CRIR_M1_task(CRIR_M1_task &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+            CRIR_M1_task(const CRIR_M1_task &) = delete;
+            CRIR_M1_task &operator=(const CRIR_M1_task &) = delete;
+            ~CRIR_M1_task() { if (handle) handle.destroy(); }
+
+            std::coroutine_handle<promise_type> release() {                  // Give ownership of coroutine to executor
+                std::coroutine_handle<promise_type> h = handle;
+                handle = nullptr;
+                return h;
+            }
+
+        private:
+            explicit CRIR_M1_task(std::coroutine_handle<promise_type> h) : handle(h) {}
+            std::coroutine_handle<promise_type> handle;
+    };
+
+
+    // Single-threaded executor, resumes each task when what it awaits is complete
+    class CRIR_M1_executor
+    {
+        public:
+            CRIR_M1_executor() : count(0), resumed(false), idle(nullptr) {
+                for (uint8_t i = 0; i < CRIR_M1_EXECUTOR_MAX_TASKS; i++) {
+                    tasks[i] = nullptr;
+                    waiting[i] = nullptr;
+                    poll[i] = nullptr;
+                }
+            }
+
+            ~CRIR_M1_executor() {
+                for (uint8_t i = 0; i < CRIR_M1_EXECUTOR_MAX_TASKS; i++) {
+                    if (tasks[i]) tasks[i].destroy();
+                }
+            }
+
+            CRIR_M1_executor(const CRIR_M1_executor &) = delete;
+            CRIR_M1_executor &operator=(const CRIR_M1_executor &) = delete;
+
+            /* Add task, returns false if executor is full */
+            bool spawn(CRIR_M1_task &&task) {
+                for (uint8_t i = 0; i < CRIR_M1_EXECUTOR_MAX_TASKS; i++) {
+                    if (!tasks[i]) {
+                        tasks[i] = task.release();
+                        tasks[i].promise().executor = this;
+                        waiting[i] = nullptr;
+                        count++;
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            /* Poll pending sensors and resume ready tasks, returns true while tasks remain */
+            bool run_once() {
+                resumed = false;
+                for (uint8_t i = 0; i < CRIR_M1_EXECUTOR_MAX_TASKS; i++) {
+                    if (!tasks[i]) continue;
+
+                    if (waiting[i] != nullptr) {
+                        if (poll[i](waiting[i]) == CRIR_M1_TRANSACTION_PENDING) continue;
+                        waiting[i] = nullptr;
+                    }
+
+                    tasks[i].resume();
+                    resumed = true;
+
+                    if (tasks[i].done()) {
+                        tasks[i].destroy();
+                        tasks[i] = nullptr;
+                        count--;
+                    }
+                }
+                return count > 0;
+            }
+
+            /* Run until all tasks finish, idle function is called when no task was resumed */
+            void run() {
+                while (run_once()) {
+                    if (!resumed && idle != nullptr) {
+                        idle();
+                    }
+#ifdef ARDUINO
+                    yield();
+#endif
+                }
+            }
+
+            /* Set function called while all tasks wait answers (sleep, delay(1)...), nullptr for none */
+            void set_idle(void (*function)()) { idle = function; }
+
+            /* Number of running tasks */
+            uint8_t tasks_count() { return count; }
+
+            /* Suspend task until poll function of awaited object is not CRIR_M1_TRANSACTION_PENDING (used by awaitables) */
+            void park(std::coroutine_handle<CRIR_M1_task::promise_type> h, void *object, uint8_t (*poll_function)(void *object)) {
+                for (uint8_t i = 0; i < CRIR_M1_EXECUTOR_MAX_TASKS; i++) {
+                    if (tasks[i] == h) {
+                        waiting[i] = object;
+                        poll[i] = poll_function;
+                        return;
+                    }
+                }
+            }
+
+        private:
+            std::coroutine_handle<CRIR_M1_task::promise_type> tasks[CRIR_M1_EXECUTOR_MAX_TASKS];   // Tasks owned by executor
+            void *waiting[CRIR_M1_EXECUTOR_MAX_TASKS];                                             // Object which each task is waiting for
+            uint8_t (*poll[CRIR_M1_EXECUTOR_MAX_TASKS])(void *object);                             // Poll function of each waiting object
+            uint8_t count;                                                                         // Number of tasks
+            bool resumed;                                                                          // A task was resumed in last run_once()
+            void (*idle)();                                                                        // Called while all tasks wait, nullptr for none
+    };
+
+
+    // Awaitable read of registers
+    template <class Transport>
+    class CRIR_M1_read_awaitable
+    {
+        public:
+            CRIR_M1_read_awaitable(CRIR_M1T<Transport> &sensor, uint8_t func, uint16_t reg, uint16_t words, int32_t (*convert)(int32_t raw))
+                : sensor(sensor), func(func), reg(reg), words(words), convert(convert), sent(false) {}
+
+            bool await_ready() { return false; }
+
+            bool await_suspend(std::coroutine_handle<CRIR_M1_task::promise_type> h) {
+                sent = sensor.request_registers(func, reg, words);
+                if (!sent && !can_retry()) {
+                    return false;                                            // Resume now with error
+                }
+                h.promise().executor->park(h, this, poll);
+                return true;
+            }
+
+            CRIR_M1_async_result await_resume() {
+                CRIR_M1_async_result result = { CRIR_M1_TRANSACTION_ERROR, 0 };
+                if (sent && sensor.poll_response() == CRIR_M1_TRANSACTION_DONE) {
+                    result.state = CRIR_M1_TRANSACTION_DONE;
+                    result.value = sensor.response_value();
+                    if (convert != nullptr) {
+                        result.value = convert(result.value);
+                    }
+                }
+                return result;
+            }
+
+        private:
+            CRIR_M1T<Transport> &sensor;
+            uint8_t func;
+            uint16_t reg;
+            uint16_t words;
+            int32_t (*convert)(int32_t raw);
+            bool sent;
+
+            /* Request was not sent because link is down or sensor is busy */
+            bool can_retry() {
+                return sensor.last_status() == CRIR_M1_ERR_LINK_DOWN || sensor.last_status() == CRIR_M1_ERR_BUSY;
+            }
+
+            /* Send request when possible, then collect answer (called by executor) */
+            static uint8_t poll(void *object) {
+                CRIR_M1_read_awaitable *a = static_cast<CRIR_M1_read_awaitable *>(object);
+                if (!a->sent) {
+                    a->sent = a->sensor.request_registers(a->func, a->reg, a->words);
+                    if (!a->sent) {
+                        return a->can_retry() ? CRIR_M1_TRANSACTION_PENDING : CRIR_M1_TRANSACTION_ERROR;
+                    }
+                }
+                return a->sensor.poll_response();
+            }
+    };
+
+
+    // Awaitable getters of a sensor
+    template <class Transport>
+    class CRIR_M1_asyncT
+    {
+        public:
+            typedef CRIR_M1_read_awaitable<Transport> awaitable;
+
+            CRIR_M1_asyncT(CRIR_M1T<Transport> &sensor) : sensor(sensor) {}
+
+            awaitable read_co2() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR8, 1, nullptr); }
+            awaitable read_temperature() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR5, 1, convert_temperature); }
+            awaitable read_meter_status() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR6, 1, nullptr); }
+            awaitable read_output_status() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR7, 1, nullptr); }
+            awaitable read_PWM_output() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR9, 1, nullptr); }
+            awaitable read_sensor_type_ID() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR10, 2, nullptr); }
+            awaitable read_sensor_ID() { return awaitable(sensor, MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR14, 2, nullptr); }
+            awaitable read_ABC_period() { return awaitable(sensor, MODBUS_FUNC_READ_HOLDING_REGISTERS, MODBUS_HR5, 1, nullptr); }
+            awaitable read_user_concentration() { return awaitable(sensor, MODBUS_FUNC_READ_HOLDING_REGISTERS, MODBUS_HR8, 1, nullptr); }
+
+        private:
+            CRIR_M1T<Transport> &sensor;
+
+            static int32_t convert_temperature(int32_t raw) { return (((uint16_t) raw) / 100) - 100; }
+    };
+
+    #ifdef ARDUINO
+    typedef CRIR_M1_asyncT<CRIR_M1_stream_transport> CRIR_M1_async;
+    #endif
+
+    #endif
+
+#endif
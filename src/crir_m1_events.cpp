@@ -0,0 +1,206 @@
+/*******************************************************************
+  CRIR M1 Library - Events
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*******************************************************************/
+
+#include "crir_m1_events.h"
+
+#define CRIR_M1_EVENTS_METER_MASK  (CRIR_M1_MASK_METER_OUT_OF_RANGE | CRIR_M1_MASK_METER_MEMORY_ERROR)
+
+
+/* Initialize */
+CRIR_M1_events::CRIR_M1_events()
+{
+    deadband = 0;
+    co2_reported = false;
+    last_co2 = 0;
+    n_thresholds = 0;
+    meter_bits = 0;
+    alarm_bits = 0;
+    callback = NULL;
+    callback_arg = NULL;
+    head = 0;
+    count = 0;
+    lost = 0;
+}
+
+
+/* Set CO2 deadband in ppm */
+void CRIR_M1_events::set_deadband(int16_t ppm) {
+    deadband = (ppm > 0) ? ppm : 0;
+}
+
+
+/* Add CO2 threshold */
+bool CRIR_M1_events::add_threshold(int16_t ppm, int16_t hysteresis) {
+
+    if (n_thresholds >= CRIR_M1_EVENTS_MAX_THRESHOLDS || hysteresis < 0) {
+        return false;
+    }
+
+    threshold[n_thresholds] = ppm;
+    this->hysteresis[n_thresholds] = hysteresis;
+    above[n_thresholds] = false;
+    n_thresholds++;
+
+    return true;
+}
+
+
+/* Deliver events to callback instead of queue */
+void CRIR_M1_events::set_callback(CRIR_M1_event_callback callback, void *arg) {
+    this->callback = callback;
+    callback_arg = arg;
+}
+
+
+/* Evaluate all values of a reading */
+void CRIR_M1_events::feed(uint32_t timestamp, int16_t co2, int16_t meter_status, int16_t output_status) {
+    feed_co2(timestamp, co2);
+    feed_status(timestamp, meter_status, output_status);
+}
+
+
+/* Evaluate a reading with status of request, values of failed requests are ignored */
+void CRIR_M1_events::feed(uint32_t timestamp, int16_t co2, int16_t meter_status, int16_t output_status, uint8_t status) {
+    feed_co2(timestamp, co2, status);
+    feed_status(timestamp, meter_status, output_status, status);
+}
+
+
+/* Evaluate CO2 value if status is CRIR_M1_OK (value of a failed request is not real) */
+void CRIR_M1_events::feed_co2(uint32_t timestamp, int16_t co2, uint8_t status) {
+    if (status == CRIR_M1_OK) {
+        feed_co2(timestamp, co2);
+    }
+}
+
+
+/* Evaluate CO2 value */
+void CRIR_M1_events::feed_co2(uint32_t timestamp, int16_t co2) {
+
+    // Change bigger than deadband
+    if (deadband > 0) {
+        int32_t diff = (int32_t) co2 - last_co2;
+        if (!co2_reported || diff >= deadband || diff <= -deadband) {
+            emit(CRIR_M1_EVENT_CO2_CHANGE, 0, co2, last_co2, timestamp);
+            last_co2 = co2;
+            co2_reported = true;
+        }
+    }
+
+    // Threshold crossings with hysteresis
+    for (uint8_t i = 0; i < n_thresholds; i++) {
+        if (!above[i] && co2 >= threshold[i]) {
+            above[i] = true;
+            emit(CRIR_M1_EVENT_THRESHOLD_ABOVE, i, co2, threshold[i], timestamp);
+        } else if (above[i] && (int32_t) co2 < (int32_t) threshold[i] - hysteresis[i]) {
+            above[i] = false;
+            emit(CRIR_M1_EVENT_THRESHOLD_BELOW, i, co2, threshold[i], timestamp);
+        }
+    }
+}
+
+
+/* Evaluate status if status of request is CRIR_M1_OK or CRIR_M1_ERR_METER (memory error is a valid meter status) */
+void CRIR_M1_events::feed_status(uint32_t timestamp, int16_t meter_status, int16_t output_status, uint8_t status) {
+    if (status == CRIR_M1_OK || status == CRIR_M1_ERR_METER) {
+        feed_status(timestamp, meter_status, output_status);
+    }
+}
+
+
+/* Evaluate meter and output status */
+void CRIR_M1_events::feed_status(uint32_t timestamp, int16_t meter_status, int16_t output_status) {
+
+    int16_t bits;
+
+    bits = meter_status & CRIR_M1_EVENTS_METER_MASK;
+    if (bits != meter_bits) {
+        emit(CRIR_M1_EVENT_METER_STATUS, 0, bits, meter_bits, timestamp);
+        meter_bits = bits;
+    }
+
+    bits = output_status & CRIR_M1_MASK_OUTPUT_ALARM;
+    if (bits != alarm_bits) {
+        emit(CRIR_M1_EVENT_ALARM, 0, bits, alarm_bits, timestamp);
+        alarm_bits = bits;
+    }
+}
+
+
+/* Get oldest event of queue */
+bool CRIR_M1_events::pop(CRIR_M1_event &event) {
+
+    if (count == 0) {
+        return false;
+    }
+
+    event = queue[head];
+    head = (head + 1) % CRIR_M1_EVENTS_QUEUE_LEN;
+    count--;
+
+    return true;
+}
+
+
+/* Events waiting in queue */
+uint8_t CRIR_M1_events::pending() {
+    return count;
+}
+
+
+/* Events lost because queue was full */
+uint16_t CRIR_M1_events::dropped() {
+    return lost;
+}
+
+
+/* Deliver event */
+void CRIR_M1_events::emit(uint8_t type, uint8_t index, int16_t value, int16_t previous, uint32_t timestamp) {
+
+    CRIR_M1_event event;
+
+    event.type = type;
+    event.index = index;
+    event.value = value;
+    event.previous = previous;
+    event.timestamp = timestamp;
+
+    if (callback != NULL) {
+        callback(event, callback_arg);
+        return;
+    }
+
+    // Drop oldest event if queue is full
+    if (count == CRIR_M1_EVENTS_QUEUE_LEN) {
+        head = (head + 1) % CRIR_M1_EVENTS_QUEUE_LEN;
+        count--;
+        if (lost < 0xFFFF) {
+            lost++;
+        }
+    }
+
+    queue[(head + count) % CRIR_M1_EVENTS_QUEUE_LEN] = event;
+    count++;
+}
@@ -0,0 +1,118 @@
+/*******************************************************************
+  CRIR M1 Library - Events
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Evaluate each new reading and generate events only when something
+meaningful changes:
+
+- CO2 moved at least the deadband (ppm) from the last reported value
+- CO2 crossed a threshold (rising at threshold, falling below threshold
+  minus hysteresis)
+- Bits CRIR_M1_MASK_METER_OUT_OF_RANGE / CRIR_M1_MASK_METER_MEMORY_ERROR
+  of meter status changed
+- Bit CRIR_M1_MASK_OUTPUT_ALARM of output status changed
+
+Events are delivered to a callback if one is set, otherwise they are saved
+in a fixed-size queue (oldest event is dropped when queue is full).
+
+Getters without status return 0 when the request fails, which would be
+seen as a CO2 drop. Pass the status of the request, failed readings are
+ignored (meter status is still evaluated with CRIR_M1_ERR_METER, it is the
+reading that reports the memory error):
+
+int16_t co2;
+uint8_t status = sensor.get_co2(co2);
+events.feed_co2(now, co2, status);
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_EVENTS
+    #define _CRIR_M1_EVENTS
+
+    #include "crir_m1.h"
+
+    #ifndef CRIR_M1_EVENTS_QUEUE_LEN
+        #define CRIR_M1_EVENTS_QUEUE_LEN       8      // Max events waiting in queue
+    #endif
+
+    #ifndef CRIR_M1_EVENTS_MAX_THRESHOLDS
+        #define CRIR_M1_EVENTS_MAX_THRESHOLDS  4      // Max CO2 thresholds
+    #endif
+
+    // Event types
+    #define CRIR_M1_EVENT_CO2_CHANGE               (0)      // CO2 changed more than deadband
+    #define CRIR_M1_EVENT_THRESHOLD_ABOVE          (1)      // CO2 rose up to threshold
+    #define CRIR_M1_EVENT_THRESHOLD_BELOW          (2)      // CO2 fell below threshold minus hysteresis
+    #define CRIR_M1_EVENT_METER_STATUS             (3)      // Meter status bits changed
+    #define CRIR_M1_EVENT_ALARM                    (4)      // Alarm output changed
+
+
+    struct CRIR_M1_event {
+        uint8_t type;                                                        // Event type
+        uint8_t index;                                                       // Threshold index (threshold events)
+        int16_t value;                                                       // CO2 value or new status bits
+        int16_t previous;                                                    // Last reported CO2 value or previous status bits
+        uint32_t timestamp;                                                  // Time of reading
+    };
+
+    typedef void (*CRIR_M1_event_callback)(const CRIR_M1_event &event, void *arg);
+
+    class CRIR_M1_events
+    {
+        public:
+            CRIR_M1_events();                                                                 // Initialize
+            void set_deadband(int16_t ppm);                                                   // Set CO2 deadband in ppm (0 disables change events)
+            bool add_threshold(int16_t ppm, int16_t hysteresis);                              // Add CO2 threshold, false if there is no room
+            void set_callback(CRIR_M1_event_callback callback, void *arg);                    // Deliver events to callback instead of queue
+            void feed(uint32_t timestamp, int16_t co2, int16_t meter_status, int16_t output_status); // Evaluate all values of a reading
+            void feed(uint32_t timestamp, int16_t co2, int16_t meter_status, int16_t output_status, uint8_t status); // Evaluate a reading with status of request
+            void feed_co2(uint32_t timestamp, int16_t co2);                                   // Evaluate CO2 value
+            void feed_co2(uint32_t timestamp, int16_t co2, uint8_t status);                   // Evaluate CO2 value if status is CRIR_M1_OK
+            void feed_status(uint32_t timestamp, int16_t meter_status, int16_t output_status);      // Evaluate meter and output status
+            void feed_status(uint32_t timestamp, int16_t meter_status, int16_t output_status, uint8_t status); // Evaluate status if status of request is CRIR_M1_OK or CRIR_M1_ERR_METER
+            bool pop(CRIR_M1_event &event);                                                   // Get oldest event of queue, false if empty
+            uint8_t pending();                                                                // Events waiting in queue
+            uint16_t dropped();                                                               // Events lost because queue was full
+
+        private:
+            int16_t deadband;                                                                 // CO2 deadband in ppm
+            bool co2_reported;                                                                // A CO2 value was reported
+            int16_t last_co2;                                                                 // Last reported CO2 value
+            uint8_t n_thresholds;                                                             // Number of thresholds
+            int16_t threshold[CRIR_M1_EVENTS_MAX_THRESHOLDS];                                 // Thresholds in ppm
+            int16_t hysteresis[CRIR_M1_EVENTS_MAX_THRESHOLDS];                                // Hysteresis of each threshold
+            bool above[CRIR_M1_EVENTS_MAX_THRESHOLDS];                                        // CO2 is above each threshold
+            int16_t meter_bits;                                                               // Last meter status bits
+            int16_t alarm_bits;                                                               // Last alarm output bit
+            CRIR_M1_event_callback callback;                                                  // Event callback
+            void *callback_arg;                                                               // Argument of callback
+            CRIR_M1_event queue[CRIR_M1_EVENTS_QUEUE_LEN];                                    // Event queue
+            uint8_t head;                                                                     // Index of oldest event
+            uint8_t count;                                                                    // Events in queue
+            uint16_t lost;                                                                    // Events dropped
+
+            void emit(uint8_t type, uint8_t index, int16_t value, int16_t previous, uint32_t timestamp); // Deliver event
+    };
+
+#endif
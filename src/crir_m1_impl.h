@@ -0,0 +1,1018 @@
+/*******************************************************************
+  CRIR M1 Library
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Member functions of CRIR_M1T<Transport>, included at the end of crir_m1.h.
+
+*******************************************************************/
+
+#ifndef _CRIR_M1_IMPL
+    #define _CRIR_M1_IMPL
+
+#include "modbus_crc.h"
+
+#if CRIR_M1_SHARED_BUFFER
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::buf_msg[CRIR_M1_LEN_BUF_MSG];
+#endif
+
+/* Initialize */
+template <class Transport>
+CRIR_M1T<Transport>::CRIR_M1T(const Transport &transport) : transport(transport)
+{
+#if CRIR_M1_FEATURE_ASYNC
+    rx_state = CRIR_M1_TRANSACTION_IDLE;
+    rx_func = 0;
+    rx_expected = 0;
+    rx_count = 0;
+    rx_start = 0;
+#if CRIR_M1_FEATURE_HEALTH
+    rx_probe = false;
+#endif
+#endif
+    status = CRIR_M1_OK;
+    link = CRIR_M1_LINK_HEALTHY;
+    n_failures = 0;
+    meter_bits = 0;
+#if CRIR_M1_FEATURE_HEALTH
+    probe_at = 0;
+    probe_interval = CRIR_M1_PROBE_MIN_MS;
+    abc_saved = false;
+    abc_period = 0;
+    concentration_saved = false;
+    user_concentration = 0;
+    config_pending = false;
+    meter_countdown = CRIR_M1_METER_CHECK_EVERY;
+#endif
+}
+
+#if CRIR_M1_FEATURE_IDENTITY
+/* Get serial number */
+template <class Transport>
+void CRIR_M1T<Transport>::get_serial_number(char sn[] ) {
+
+    if (sn == NULL) {
+        return;
+    }
+
+    strcpy(sn, "");
+
+    // Ask serial number
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR16, 0x0005) == CRIR_M1_OK) {
+
+        strncat(sn, (const char *) &buf_msg[3], CRIR_M1_LEN_SN);
+        CRIR_M1_LOG("DEBUG: Serial number: %s\n", sn);
+
+    } else {
+        CRIR_M1_LOG("DEBUG: Serial number not available!\n");
+    }
+
+}
+
+
+/* Get software version */
+template <class Transport>
+void CRIR_M1T<Transport>::get_software_version(char softver[]) {
+
+    if (softver == NULL) {
+        return;
+    }
+
+    strcpy(softver, "");
+
+    // Ask software version
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR13, 0x0001) == CRIR_M1_OK) {
+        snprintf(softver, CRIR_M1_LEN_SOFTVER, "%0u.%0u", buf_msg[3], buf_msg[4]);
+        CRIR_M1_LOG("DEBUG: Software version: %s\n", softver);
+    } else {
+        CRIR_M1_LOG("DEBUG: Software version not available!\n");
+    }
+    
+}
+#endif
+
+
+/* Get CO2 value in ppm */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_co2() {
+
+    int16_t co2 = 0;
+
+    get_co2(co2);
+    return co2;
+}
+
+
+/* Get CO2 value in ppm, returns status (co2 is not changed if request fails) */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::get_co2(int16_t &co2) {
+
+    // Ask CO2 value
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR8, 0x0001) == CRIR_M1_OK) {
+        co2 = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: CO2 value = %d ppm\n", co2);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting CO2 value!\n");
+    }
+    return status;
+}
+
+
+/* Get temperature in celsius degree */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_temperature() {
+
+    int16_t temp = 0;
+
+    get_temperature(temp);
+    return temp;
+}
+
+
+/* Get temperature in celsius degree, returns status (temperature is not changed if request fails) */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::get_temperature(int16_t &temperature) {
+
+    // Ask temperature value
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR5, 0x0001) == CRIR_M1_OK) {
+        temperature = (((buf_msg[3] * 256) + buf_msg[4]) / 100) - 100;
+        CRIR_M1_LOG("DEBUG: Temperature value = %d C\n", temperature);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting temperature value!\n");
+    }
+    return status;
+}
+
+
+/* Get status of last request */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::last_status() {
+    return status;
+}
+
+
+/* Get link state */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::link_state() {
+    return link;
+}
+
+
+/* Get consecutive failed requests */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::failures() {
+    return n_failures;
+}
+
+
+#if CRIR_M1_FEATURE_HEALTH
+/* Probe a down link when it is time */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::check_link() {
+
+    if (link != CRIR_M1_LINK_DOWN) {
+        restore_config();                           // Link recovered by a non-blocking request
+        return link;
+    }
+    if ((long) (transport.now_ms() - probe_at) < 0) {
+        return link;
+    }
+
+    // Cheap probe, one register
+    CRIR_M1_LOG("DEBUG: Probing link\n");
+    status = transaction(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR6, 0x0001);
+    if (status == CRIR_M1_ERR_BUSY) {
+        return link;                                // Probe later, answer of pending request would be taken
+    }
+    if (status == CRIR_M1_OK) {
+        meter_bits = (((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF)) & (CRIR_M1_MASK_METER_OUT_OF_RANGE | CRIR_M1_MASK_METER_MEMORY_ERROR);
+        if (!(meter_bits & CRIR_M1_MASK_METER_MEMORY_ERROR)) {
+            recover();
+            restore_config();
+            return link;
+        }
+        status = CRIR_M1_ERR_METER;
+    }
+
+    next_probe();
+
+    return link;
+}
+#endif
+
+
+#if CRIR_M1_FEATURE_CONFIGURATION
+/* Read ABC period */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_ABC_period() {
+
+    int16_t period = 0;
+
+    // Ask ABC period
+    if (read_registers(MODBUS_FUNC_READ_HOLDING_REGISTERS, MODBUS_HR5, 0x0001) == CRIR_M1_OK) {
+        period = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: ABC period = %d hours\n", period);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting ABC period!\n");
+    }
+    return period;
+}
+
+
+/* Setup ABC period */
+template <class Transport>
+bool CRIR_M1T<Transport>::set_ABC_period(int16_t period) {
+    bool result = false;
+
+    if (period == 0 || (period >= 4 && period <= 4800)) {
+
+        // Ask set ABC period
+        if (write_register(MODBUS_HR5, period)) {
+            result = true;
+#if CRIR_M1_FEATURE_HEALTH
+            abc_saved = true;                       // Set again after link recovery
+            abc_period = period;
+#endif
+            CRIR_M1_LOG("DEBUG: Successful setting of ABC period\n");
+        } else {
+            CRIR_M1_LOG("DEBUG: Error in setting of ABC period!\n");
+        }
+
+    } else {
+        CRIR_M1_LOG("DEBUG: Invalid ABC period!\n");
+    }
+
+    return result;
+}
+#endif
+
+
+#if CRIR_M1_FEATURE_CALIBRATION
+/* Read user concentration */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_user_concentration() {
+
+    int16_t concentration = 0;
+
+    // Ask ABC period
+    if (read_registers(MODBUS_FUNC_READ_HOLDING_REGISTERS, MODBUS_HR8, 0x0001) == CRIR_M1_OK) {
+        concentration = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: User concentration = %d ppm\n", concentration);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting user concentration!\n");
+    }
+    return concentration;
+}
+
+
+/* Setup user concentration */
+template <class Transport>
+bool CRIR_M1T<Transport>::set_user_concentration(int16_t concentration) {
+    bool result = false;
+
+    if (concentration >= 400 && concentration <= 2000) {
+
+        // Ask set user concentration
+        if (write_register(MODBUS_HR8, concentration)) {
+            result = true;
+#if CRIR_M1_FEATURE_HEALTH
+            concentration_saved = true;             // Set again after link recovery
+            user_concentration = concentration;
+#endif
+            CRIR_M1_LOG("DEBUG: Successful setting user concentration\n");
+        } else {
+            CRIR_M1_LOG("DEBUG: Error in setting user concentration!\n");
+        }
+
+    } else {
+        CRIR_M1_LOG("DEBUG: Invalid user concentration!\n");
+    }
+
+    return result;
+}
+
+
+/* Read user acknowledgement */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_user_acknowledgement() {
+
+    int16_t flag = 0;
+
+    // Ask user acknowledgement
+    if (read_registers(MODBUS_FUNC_READ_HOLDING_REGISTERS, MODBUS_HR6, 0x0001) == CRIR_M1_OK) {
+        flag = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: User acknowledgement flag = %d\n", flag);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting user acknowledgement flag!\n");
+    }
+    return flag;
+}
+
+
+/* Setup user acknowledgement */
+template <class Transport>
+bool CRIR_M1T<Transport>::set_user_acknowledgement(int16_t flag) {
+    bool result = false;
+
+    // Ask set user acknowledgement
+    if (write_register(MODBUS_HR6, flag)) {
+        result = true;
+        CRIR_M1_LOG("DEBUG: Successful setting user acknowledgement\n");
+    } else {
+        CRIR_M1_LOG("DEBUG: Error in setting user acknowledgement!\n");
+    }
+
+    return result;
+}
+
+
+/* Setup user special command */
+template <class Transport>
+bool CRIR_M1T<Transport>::set_user_special_command(int16_t command) {
+    bool result = false;
+
+    // Ask set user special command
+    if (write_register(MODBUS_HR7, command)) {
+        result = true;
+        CRIR_M1_LOG("DEBUG: Successful setting user special command\n");
+    } else {
+        CRIR_M1_LOG("DEBUG: Error in setting user special command!\n");
+    }
+
+    return result;
+}
+#endif
+
+
+#if CRIR_M1_FEATURE_DIAGNOSTICS
+/* Read meter status */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_meter_status() {
+
+    int16_t meter = 0;
+
+    get_meter_status(meter);
+    return meter;
+}
+
+
+/* Read meter status, returns status of request (CRIR_M1_ERR_METER if memory error) */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::get_meter_status(int16_t &meter) {
+
+    // Ask meter status
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR6, 0x0001) == CRIR_M1_OK) {
+        meter = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: Meter status = b");
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)
+        print_binary(meter);
+#endif
+        CRIR_M1_LOG("\n");
+        check_meter(meter);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting meter status!\n");
+    }
+    return status;
+}
+
+
+/* Read output status */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_output_status() {
+
+    int16_t output = 0;
+
+    get_output_status(output);
+    return output;
+}
+
+
+/* Read output status, returns status of request */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::get_output_status(int16_t &output) {
+
+    // Ask output status
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR7, 0x0001) == CRIR_M1_OK) {
+        output = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: Output status = b");
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)
+        print_binary(output);
+#endif
+        CRIR_M1_LOG("\n");
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting output status!\n");
+    }
+    return status;
+}
+
+
+/* Read PWM output */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_PWM_output() {
+
+    int16_t pwm = 0;
+
+    // Ask PWM output
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR9, 0x0001) == CRIR_M1_OK) {
+        pwm = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: PWM output = %d\n", pwm);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting PWM output!\n");
+    }
+    return pwm;
+}
+#endif
+
+
+#if CRIR_M1_FEATURE_IDENTITY
+/* Read sensor type ID */
+template <class Transport>
+int32_t CRIR_M1T<Transport>::get_sensor_type_ID() {
+
+    int32_t sensorType = 0;
+
+    // Ask sensor type ID
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR10, 0x0002) == CRIR_M1_OK) {
+        sensorType = ((buf_msg[3] << 24) & 0xFF000000) | ((buf_msg[4] << 16) & 0x00FF0000) | ((buf_msg[5] << 8) & 0x0000FF00) | (buf_msg[6] & 0x000000FF);
+        CRIR_M1_LOG("DEBUG: Sensor type ID = 0x%08x\n", sensorType);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting sensor type ID!\n");
+    }
+    return sensorType;
+}
+
+
+/* Read sensor ID */
+template <class Transport>
+int32_t CRIR_M1T<Transport>::get_sensor_ID() {
+
+    int32_t sensorID = 0;
+
+    // Ask sensor ID
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR14, 0x0002) == CRIR_M1_OK) {
+        sensorID = ((buf_msg[3] << 24) & 0xFF000000) | ((buf_msg[4] << 16) & 0x00FF0000) | ((buf_msg[5] << 8) & 0x0000FF00) | (buf_msg[6] & 0x000000FF);
+        CRIR_M1_LOG("DEBUG: Sensor ID = 0x%08x\n", sensorID);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting sensor ID!\n");
+    }
+    return sensorID;
+}
+
+
+/* Read memory map version */
+template <class Transport>
+int16_t CRIR_M1T<Transport>::get_memory_map_version() {
+
+    int16_t mmVersion = 0;
+
+    // Ask memory map version
+    if (read_registers(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR9, 0x0001) == CRIR_M1_OK) {
+        mmVersion = ((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF);
+        CRIR_M1_LOG("DEBUG: Memory map version = %04x\n", mmVersion);
+    } else {
+        CRIR_M1_LOG("DEBUG: Error getting memory map version!\n");
+    }
+    return mmVersion;
+}
+#endif
+
+
+#if CRIR_M1_FEATURE_ASYNC
+/* Send read request without waiting answer */
+template <class Transport>
+bool CRIR_M1T<Transport>::request_registers(uint8_t func, uint16_t reg, uint16_t words) {
+
+    if (rx_state == CRIR_M1_TRANSACTION_PENDING) {
+        CRIR_M1_LOG("DEBUG: Request already pending!\n");
+        status = CRIR_M1_ERR_BUSY;
+        return false;
+    }
+
+#if CRIR_M1_FEATURE_HEALTH
+    // While link is down, only send request when it is time to probe it
+    if (link == CRIR_M1_LINK_DOWN && (long) (transport.now_ms() - probe_at) < 0) {
+        status = CRIR_M1_ERR_LINK_DOWN;
+        return false;
+    }
+#endif
+
+    if ((func != MODBUS_FUNC_READ_HOLDING_REGISTERS && func != MODBUS_FUNC_READ_INPUT_REGISTERS) || words < 1 || (5 + 2 * words) > CRIR_M1_LEN_BUF_MSG) {
+        CRIR_M1_LOG("DEBUG: Invalid parameters!\n");
+        return false;
+    }
+
+    // Discard old bytes, answer is collected byte to byte
+    while (transport.available()) {
+        transport.read();
+    }
+
+    // Ask registers
+    send_cmd(func, reg, words);
+
+    memset(buf_msg, 0, CRIR_M1_LEN_BUF_MSG);
+    rx_func = func;
+    rx_expected = 5 + 2 * words;
+    rx_count = 0;
+    rx_start = transport.now_ms();
+    rx_state = CRIR_M1_TRANSACTION_PENDING;
+#if CRIR_M1_FEATURE_HEALTH
+    rx_probe = (link == CRIR_M1_LINK_DOWN);
+#endif
+
+    return true;
+}
+
+
+/* Collect answer bytes without blocking */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::poll_response() {
+
+    if (rx_state != CRIR_M1_TRANSACTION_PENDING) {
+        return rx_state;
+    }
+
+    while (rx_count < rx_expected && transport.available()) {
+        buf_msg[rx_count++] = transport.read();
+    }
+
+    if (rx_count == rx_expected) {
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)
+        CRIR_M1_LOG("DEBUG: Bytes received => ");
+        print_buffer(rx_count);
+#endif
+        if (valid_response(rx_func, rx_count)) {
+            rx_state = CRIR_M1_TRANSACTION_DONE;
+            status = CRIR_M1_OK;
+        } else {
+            rx_state = CRIR_M1_TRANSACTION_ERROR;
+            status = CRIR_M1_ERR_RESPONSE;
+        }
+        update_health(status);
+    } else if (transport.now_ms() - rx_start > CRIR_M1_TIMEOUT_MS) {
+        CRIR_M1_LOG("DEBUG: Timeout waiting answer (%u bytes)\n", rx_count);
+        rx_state = CRIR_M1_TRANSACTION_ERROR;
+        status = (rx_count == 0) ? CRIR_M1_ERR_TIMEOUT : CRIR_M1_ERR_RESPONSE;
+        update_health(status);
+    }
+
+#if CRIR_M1_FEATURE_HEALTH
+    // Answer of a probe. A memory error is only cleared reading the meter
+    // status again (check_link()), configuration is sent by next blocking call
+    if (rx_probe && rx_state != CRIR_M1_TRANSACTION_PENDING) {
+        rx_probe = false;
+        if (status == CRIR_M1_OK && (meter_bits & CRIR_M1_MASK_METER_MEMORY_ERROR)) {
+            rx_state = CRIR_M1_TRANSACTION_ERROR;
+            status = CRIR_M1_ERR_METER;
+            next_probe();
+        } else if (status == CRIR_M1_OK) {
+            recover();
+        } else {
+            next_probe();
+        }
+    }
+#endif
+
+    return rx_state;
+}
+
+
+/* Get value of last completed request */
+template <class Transport>
+int32_t CRIR_M1T<Transport>::response_value() {
+
+    int32_t value = 0;
+
+    if (rx_state == CRIR_M1_TRANSACTION_DONE) {
+        if (rx_expected == 7) {
+            value = (int16_t) (((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF));
+        } else {
+            value = ((buf_msg[3] << 24) & 0xFF000000) | ((buf_msg[4] << 16) & 0x00FF0000) | ((buf_msg[5] << 8) & 0x0000FF00) | (buf_msg[6] & 0x000000FF);
+        }
+    }
+
+    return value;
+}
+#endif
+
+
+/* Check valid response and length of received message */
+template <class Transport>
+bool CRIR_M1T<Transport>::valid_response_len(uint8_t func, uint8_t nb, uint8_t len) {
+    bool result = false;
+
+    if (nb == len) {
+        result = valid_response(func, nb);
+    } else {
+        CRIR_M1_LOG("DEBUG: Unexpected length\n");
+    }
+
+    return result;
+}
+
+
+/* Check if it is a valid message response of the sensor */
+template <class Transport>
+bool CRIR_M1T<Transport>::valid_response(uint8_t func, uint8_t nb) {
+
+    uint16_t crc16;
+    bool result = false;
+
+    if (nb >= 7) {
+        crc16 = modbus_CRC16(buf_msg, nb-2);
+        if ((buf_msg[nb-2] == (crc16 & 0x00FF)) && (buf_msg[nb-1] == ((crc16 >> 8) & 0x00FF))) {
+
+            if (buf_msg[0] == MODBUS_ANY_ADDRESS && (buf_msg[1] == MODBUS_FUNC_READ_HOLDING_REGISTERS || buf_msg[1] == MODBUS_FUNC_READ_INPUT_REGISTERS) && buf_msg[2] == nb-5) {
+                CRIR_M1_LOG("DEBUG: Valid response\n");
+                result = true;
+
+            } /* else if (buf_msg[0] == CM1106_MSG_NAK && nb == 4) {
+                CRIR_M1_LOG("DEBUG: Response with error 0x%02x\n", buf_msg[2]);
+                // error 0x02 = cmd not recognised, invalid checksum...
+                // If invalid length then no response.
+            } */
+
+        } else {
+            CRIR_M1_LOG("DEBUG: Checksum/length is invalid\n");
+        }
+
+    } else {
+        CRIR_M1_LOG("DEBUG: Invalid length\n");
+    }
+    
+    return result;
+}
+
+
+/* Send read request and wait answer */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::transaction(uint8_t func, uint16_t reg, uint16_t words) {
+
+    uint8_t len = 5 + 2 * words;
+
+#if CRIR_M1_FEATURE_ASYNC
+    // Answer of pending request would be taken as this one
+    if (rx_state == CRIR_M1_TRANSACTION_PENDING) {
+        CRIR_M1_LOG("DEBUG: Request pending, finish it with poll_response()!\n");
+        return CRIR_M1_ERR_BUSY;
+    }
+#endif
+
+    send_cmd(func, reg, words);
+
+    // Wait response
+    memset(buf_msg, 0, CRIR_M1_LEN_BUF_MSG);
+    uint8_t nb = serial_read_bytes(len, CRIR_M1_TIMEOUT);
+
+    // Check response
+    if (nb == 0) {
+        return CRIR_M1_ERR_TIMEOUT;
+    }
+    if (!valid_response_len(func, nb, len)) {
+        return CRIR_M1_ERR_RESPONSE;
+    }
+    return CRIR_M1_OK;
+}
+
+
+/* Read registers checking link state */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::read_registers(uint8_t func, uint16_t reg, uint16_t words) {
+
+#if CRIR_M1_FEATURE_HEALTH
+    // Fail fast while link is down, except when it is time to probe it
+    if (link == CRIR_M1_LINK_DOWN && check_link() == CRIR_M1_LINK_DOWN) {
+        status = CRIR_M1_ERR_LINK_DOWN;
+        return status;
+    }
+    restore_config();
+
+    // Meter status is not read by the application, check it from time to time
+    if (reg != MODBUS_IR6) {
+        poll_meter();
+        if (link == CRIR_M1_LINK_DOWN) {
+            status = (meter_bits & CRIR_M1_MASK_METER_MEMORY_ERROR) ? CRIR_M1_ERR_METER : CRIR_M1_ERR_LINK_DOWN;
+            return status;
+        }
+    }
+#endif
+
+    status = transaction(func, reg, words);
+    if (status != CRIR_M1_ERR_BUSY) {
+        update_health(status);
+    }
+
+    return status;
+}
+
+
+/* Update link state with status of a request */
+template <class Transport>
+void CRIR_M1T<Transport>::update_health(uint8_t result) {
+
+    if (result == CRIR_M1_OK) {
+        n_failures = 0;
+        if (link != CRIR_M1_LINK_DOWN || !CRIR_M1_FEATURE_HEALTH) {
+            link = (meter_bits & CRIR_M1_MASK_METER_OUT_OF_RANGE) ? CRIR_M1_LINK_DEGRADED : CRIR_M1_LINK_HEALTHY;
+        }
+        return;
+    }
+
+    if (n_failures < 0xFF) {
+        n_failures++;
+    }
+
+    if (link != CRIR_M1_LINK_DOWN) {
+        if (n_failures >= CRIR_M1_DOWN_FAILURES) {
+            set_link_down();
+        } else {
+            link = CRIR_M1_LINK_DEGRADED;
+        }
+    }
+}
+
+
+/* Update link state with meter status */
+template <class Transport>
+void CRIR_M1T<Transport>::check_meter(int16_t meter_status) {
+
+    meter_bits = meter_status & (CRIR_M1_MASK_METER_OUT_OF_RANGE | CRIR_M1_MASK_METER_MEMORY_ERROR);
+
+    if (meter_bits & CRIR_M1_MASK_METER_MEMORY_ERROR) {
+        status = CRIR_M1_ERR_METER;
+        if (link != CRIR_M1_LINK_DOWN) {
+            set_link_down();
+        }
+    } else if (link == CRIR_M1_LINK_HEALTHY && (meter_bits & CRIR_M1_MASK_METER_OUT_OF_RANGE)) {
+        link = CRIR_M1_LINK_DEGRADED;
+    }
+}
+
+
+/* Set link down and schedule first probe */
+template <class Transport>
+void CRIR_M1T<Transport>::set_link_down() {
+
+    CRIR_M1_LOG("DEBUG: Link down!\n");
+    link = CRIR_M1_LINK_DOWN;
+#if CRIR_M1_FEATURE_HEALTH
+    probe_interval = CRIR_M1_PROBE_MIN_MS;
+    probe_at = transport.now_ms() + probe_interval;
+#endif
+}
+
+
+#if CRIR_M1_FEATURE_HEALTH
+/* Clear state after link is up, configuration is sent later */
+template <class Transport>
+void CRIR_M1T<Transport>::recover() {
+
+    CRIR_M1_LOG("DEBUG: Link recovered\n");
+    n_failures = 0;
+    link = (meter_bits & CRIR_M1_MASK_METER_OUT_OF_RANGE) ? CRIR_M1_LINK_DEGRADED : CRIR_M1_LINK_HEALTHY;
+
+    // Forget old bytes
+    while (transport.available()) {
+        transport.read();
+    }
+
+    // Sensor may have been replaced or reset. Writes block, so they are not
+    // sent from poll_response() but by next check_link() or blocking request
+    config_pending = true;
+}
+
+
+/* Send configuration again after recovery (blocking) */
+template <class Transport>
+void CRIR_M1T<Transport>::restore_config() {
+
+    if (!config_pending) {
+        return;
+    }
+#if CRIR_M1_FEATURE_ASYNC
+    if (rx_state == CRIR_M1_TRANSACTION_PENDING) {
+        return;                                     // Echo would be mixed with the answer, send later
+    }
+#endif
+    config_pending = false;
+
+#if CRIR_M1_FEATURE_CONFIGURATION
+    if (abc_saved) {
+        write_register(MODBUS_HR5, abc_period);
+    }
+#endif
+#if CRIR_M1_FEATURE_CALIBRATION
+    if (concentration_saved) {
+        write_register(MODBUS_HR8, user_concentration);
+    }
+#endif
+}
+
+
+/* Read meter status every CRIR_M1_METER_CHECK_EVERY requests */
+template <class Transport>
+void CRIR_M1T<Transport>::poll_meter() {
+
+#if CRIR_M1_METER_CHECK_EVERY > 0
+    if (--meter_countdown > 0) {
+        return;
+    }
+
+    uint8_t result = transaction(MODBUS_FUNC_READ_INPUT_REGISTERS, MODBUS_IR6, 0x0001);
+    if (result == CRIR_M1_ERR_BUSY) {
+        meter_countdown = 1;                        // Try again with next request
+        return;
+    }
+    meter_countdown = CRIR_M1_METER_CHECK_EVERY;
+
+    update_health(result);
+    if (result == CRIR_M1_OK) {
+        check_meter(((buf_msg[3] << 8) & 0xFF00) | (buf_msg[4] & 0x00FF));
+    }
+#endif
+}
+
+
+/* Wait longer for next probe */
+template <class Transport>
+void CRIR_M1T<Transport>::next_probe() {
+
+    probe_interval = (probe_interval * 2 < CRIR_M1_PROBE_MAX_MS) ? probe_interval * 2 : CRIR_M1_PROBE_MAX_MS;
+    probe_at = transport.now_ms() + probe_interval;
+    CRIR_M1_LOG("DEBUG: Link still down, next probe in %lu ms\n", probe_interval);
+}
+#endif
+
+
+/* Send command */
+template <class Transport>
+void CRIR_M1T<Transport>::send_cmd( uint8_t func, uint16_t cmd, uint16_t value) {
+
+    uint16_t crc16;
+
+    if (((func == MODBUS_FUNC_READ_HOLDING_REGISTERS || func == MODBUS_FUNC_READ_INPUT_REGISTERS) && value >= 1) || (func == MODBUS_FUNC_PRESET_SINGLE_REGISTER)) {
+        buf_msg[0] = MODBUS_ANY_ADDRESS;                // Address
+        buf_msg[1] = func;                              // Function
+        buf_msg[2] = (cmd >> 8) & 0x00FF;               // High-input register
+        buf_msg[3] = cmd & 0x00FF;                      // Low-input register
+        buf_msg[4] = (value >> 8) & 0x00FF;             // High-word to read or setup
+        buf_msg[5] = value & 0x00FF;                    // Low-word to read or setup
+        crc16 = modbus_CRC16(buf_msg, 6);
+        //Serial.printf("CRC value: 0x%04x\n", crc16);
+        buf_msg[6] = crc16 & 0x00FF;
+        buf_msg[7] = (crc16 >> 8) & 0x00FF;
+        serial_write_bytes(8);        
+    }
+}
+
+
+#if CRIR_M1_FEATURE_CONFIGURATION || CRIR_M1_FEATURE_CALIBRATION
+/* Preset single register and check echo of the sensor */
+template <class Transport>
+bool CRIR_M1T<Transport>::write_register(uint16_t reg, int16_t value) {
+
+    uint16_t crc16;
+
+#if CRIR_M1_FEATURE_ASYNC
+    // Answer of pending request would be taken as the echo
+    if (rx_state == CRIR_M1_TRANSACTION_PENDING) {
+        CRIR_M1_LOG("DEBUG: Request pending, finish it with poll_response()!\n");
+        status = CRIR_M1_ERR_BUSY;
+        return false;
+    }
+#endif
+
+#if CRIR_M1_FEATURE_HEALTH
+    if (link == CRIR_M1_LINK_DOWN && check_link() == CRIR_M1_LINK_DOWN) {
+        status = CRIR_M1_ERR_LINK_DOWN;
+        return false;
+    }
+#endif
+
+    // Ask set register
+    send_cmd(MODBUS_FUNC_PRESET_SINGLE_REGISTER, reg, value);
+
+    // Wait response
+    memset(buf_msg, 0, CRIR_M1_LEN_BUF_MSG);
+    uint8_t nb = serial_read_bytes(8, CRIR_M1_TIMEOUT);
+
+    // Check response, sensor answers with the same bytes sent
+    crc16 = modbus_CRC16(buf_msg, 6);
+    if (nb == 0) {
+        status = CRIR_M1_ERR_TIMEOUT;
+    } else if (nb == 8 && buf_msg[0] == MODBUS_ANY_ADDRESS && buf_msg[1] == MODBUS_FUNC_PRESET_SINGLE_REGISTER &&
+               buf_msg[2] == ((reg >> 8) & 0x00FF) && buf_msg[3] == (reg & 0x00FF) &&
+               buf_msg[4] == ((value >> 8) & 0x00FF) && buf_msg[5] == (value & 0x00FF) &&
+               buf_msg[6] == (crc16 & 0x00FF) && buf_msg[7] == ((crc16 >> 8) & 0x00FF)) {
+        status = CRIR_M1_OK;
+    } else {
+        status = CRIR_M1_ERR_RESPONSE;
+    }
+    update_health(status);
+
+    return status == CRIR_M1_OK;
+}
+#endif
+
+
+/* Send bytes to sensor */
+template <class Transport>
+void CRIR_M1T<Transport>::serial_write_bytes(uint8_t size) {
+
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)     
+    CRIR_M1_LOG("DEBUG: Bytes to send => ");
+    print_buffer(size);
+#endif
+
+    transport.write(buf_msg, size);
+    transport.flush();
+}
+
+
+/* Read answer of sensor */
+template <class Transport>
+uint8_t CRIR_M1T<Transport>::serial_read_bytes(uint8_t max_bytes, int timeout_seconds) {
+
+    uint8_t nb = 0;
+    if (max_bytes > 0 && timeout_seconds > 0) {
+
+        CRIR_M1_LOG("DEBUG: Bytes received => ");
+
+        // Wait first byte up to timeout, next bytes up to CRIR_M1_BYTE_TIMEOUT_MS
+        unsigned long wait = timeout_seconds * 1000UL;
+        unsigned long last = transport.now_ms();
+        while (nb < max_bytes) {
+            unsigned long elapsed = transport.now_ms() - last;
+            if (elapsed > wait) {
+                break;
+            }
+            if (transport.available()) {
+                buf_msg[nb++] = transport.read();
+                wait = CRIR_M1_BYTE_TIMEOUT_MS;
+                last = transport.now_ms();
+            } else {
+                transport.wait(wait - elapsed);
+            }
+        }
+
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)
+        print_buffer(nb);
+#endif
+
+    } else {
+        CRIR_M1_LOG("DEBUG: Invalid parameters!\n");
+    }
+
+    return nb;
+}
+
+
+#if (CRIR_M1_LOG_LEVEL > CRIR_M1_LOG_LEVEL_NONE)
+/* Show buffer in hex bytes */
+template <class Transport>
+void CRIR_M1T<Transport>::print_buffer(uint8_t size) {
+
+    for (int i = 0; i < size; i++) {
+        CRIR_M1_LOG("0x%02x ", buf_msg[i]);
+    }
+    CRIR_M1_LOG("(%u bytes)\n", size);
+}
+
+
+/* Show number in binary */
+template <class Transport>
+void CRIR_M1T<Transport>::print_binary(int16_t number) {
+    int16_t k;
+
+    for (int8_t c = 15; c >= 0; c--)
+    {
+        k = number >> c;
+
+        if (k & 1)
+            CRIR_M1_LOG("1");
+        else
+            CRIR_M1_LOG("0");
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+/*******************************************************************
+  CRIR M1 Library - Rollup
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*******************************************************************/
+
+#include "crir_m1_rollup.h"
+
+// Period of each tier in seconds
+static const uint32_t tier_period[CRIR_M1_N_TIERS] = { 60, 900, 3600, 86400 };
+
+
+/* Initialize */
+CRIR_M1_rollup::CRIR_M1_rollup()
+{
+    clear();
+}
+
+
+/* Remove all data */
+void CRIR_M1_rollup::clear() {
+
+    raw_head = 0;
+    raw_count = 0;
+    last = 0;
+    for (uint8_t t = 0; t < CRIR_M1_N_TIERS; t++) {
+        head[t] = 0;
+        count[t] = 0;
+        open[t].count = 0;
+    }
+}
+
+
+/* Add sample */
+bool CRIR_M1_rollup::add(uint32_t timestamp, int16_t co2, int16_t temperature) {
+
+    if (raw_count > 0 && timestamp < last) {
+        return false;
+    }
+    last = timestamp;
+
+    // Raw samples, overwrite oldest when full
+    uint16_t pos = (raw_head + raw_count) % CRIR_M1_ROLLUP_RAW_LEN;
+    raw[pos].timestamp = timestamp;
+    raw[pos].co2 = co2;
+    raw[pos].temperature = temperature;
+    if (raw_count < CRIR_M1_ROLLUP_RAW_LEN) {
+        raw_count++;
+    } else {
+        raw_head = (raw_head + 1) % CRIR_M1_ROLLUP_RAW_LEN;
+    }
+
+    CRIR_M1_aggregate sample;
+    sample.count = 1;
+    sample.co2_min = sample.co2_max = co2;
+    sample.co2_sum = co2;
+    sample.temperature_min = sample.temperature_max = temperature;
+    sample.temperature_sum = temperature;
+
+    for (uint8_t t = 0; t < CRIR_M1_N_TIERS; t++) {
+        uint32_t start = timestamp - (timestamp % tier_period[t]);
+
+        // New period, save period in progress
+        if (open[t].count > 0 && open[t].start != start) {
+            CRIR_M1_aggregate *ring = items(t);
+            ring[(head[t] + count[t]) % size(t)] = open[t];
+            if (count[t] < size(t)) {
+                count[t]++;
+            } else {
+                head[t] = (head[t] + 1) % size(t);
+            }
+            open[t].count = 0;
+        }
+
+        if (open[t].count == 0) {
+            open[t] = sample;
+            open[t].start = start;
+        } else {
+            merge(open[t], sample);
+        }
+    }
+
+    return true;
+}
+
+
+/* Get raw samples in [from, to) */
+uint16_t CRIR_M1_rollup::query_raw(uint32_t from, uint32_t to, CRIR_M1_sample out[], uint16_t max) {
+
+    uint16_t n = 0;
+
+    for (uint16_t i = first_raw(from); i < raw_count && n < max; i++) {
+        const CRIR_M1_sample &s = raw[(raw_head + i) % CRIR_M1_ROLLUP_RAW_LEN];
+        if (s.timestamp >= to) {
+            break;
+        }
+        out[n++] = s;
+    }
+
+    return n;
+}
+
+
+/* Get aggregates of a tier which start in [from, to), including period in progress */
+uint16_t CRIR_M1_rollup::query(uint8_t tier, uint32_t from, uint32_t to, CRIR_M1_aggregate out[], uint16_t max) {
+
+    uint16_t n = 0;
+
+    if (tier >= CRIR_M1_N_TIERS) {
+        return 0;
+    }
+
+    CRIR_M1_aggregate *ring = items(tier);
+    for (uint16_t i = first(tier, from); i < count[tier] && n < max; i++) {
+        const CRIR_M1_aggregate &a = ring[(head[tier] + i) % size(tier)];
+        if (a.start >= to) {
+            return n;
+        }
+        out[n++] = a;
+    }
+
+    if (n < max && open[tier].count > 0 && open[tier].start >= from && open[tier].start < to) {
+        out[n++] = open[tier];
+    }
+
+    return n;
+}
+
+
+/* Merge aggregates of a tier which start in [from, to) */
+bool CRIR_M1_rollup::summary(uint8_t tier, uint32_t from, uint32_t to, CRIR_M1_summary &result) {
+
+    result.count = 0;
+
+    if (tier >= CRIR_M1_N_TIERS) {
+        return false;
+    }
+
+    CRIR_M1_aggregate *ring = items(tier);
+    for (uint16_t i = first(tier, from); i < count[tier]; i++) {
+        const CRIR_M1_aggregate &a = ring[(head[tier] + i) % size(tier)];
+        if (a.start >= to) {
+            break;
+        }
+        merge(result, a);
+    }
+
+    if (open[tier].count > 0 && open[tier].start >= from && open[tier].start < to) {
+        merge(result, open[tier]);
+    }
+
+    return result.count > 0;
+}
+
+
+/* Ring of a tier */
+CRIR_M1_aggregate *CRIR_M1_rollup::items(uint8_t tier) {
+
+    switch (tier) {
+        case CRIR_M1_TIER_MINUTE:  return minute;
+        case CRIR_M1_TIER_QUARTER: return quarter;
+        case CRIR_M1_TIER_HOUR:    return hour;
+        default:                   return day;
+    }
+}
+
+
+/* Size of ring of a tier */
+uint16_t CRIR_M1_rollup::size(uint8_t tier) {
+
+    switch (tier) {
+        case CRIR_M1_TIER_MINUTE:  return CRIR_M1_ROLLUP_MINUTE_LEN;
+        case CRIR_M1_TIER_QUARTER: return CRIR_M1_ROLLUP_QUARTER_LEN;
+        case CRIR_M1_TIER_HOUR:    return CRIR_M1_ROLLUP_HOUR_LEN;
+        default:                   return CRIR_M1_ROLLUP_DAY_LEN;
+    }
+}
+
+
+/* Position of first raw sample >= from (binary search, samples are sorted) */
+uint16_t CRIR_M1_rollup::first_raw(uint32_t from) {
+
+    uint16_t low = 0;
+    uint16_t high = raw_count;
+
+    while (low < high) {
+        uint16_t mid = low + (high - low) / 2;
+        if (raw[(raw_head + mid) % CRIR_M1_ROLLUP_RAW_LEN].timestamp < from) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+/* Position of first aggregate >= from (binary search, aggregates are sorted) */
+uint16_t CRIR_M1_rollup::first(uint8_t tier, uint32_t from) {
+
+    CRIR_M1_aggregate *ring = items(tier);
+    uint16_t low = 0;
+    uint16_t high = count[tier];
+
+    while (low < high) {
+        uint16_t mid = low + (high - low) / 2;
+        if (ring[(head[tier] + mid) % size(tier)].start < from) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+/* Add aggregate b into a */
+void CRIR_M1_rollup::merge(CRIR_M1_aggregate &a, const CRIR_M1_aggregate &b) {
+
+    if (a.count == 0) {
+        a = b;
+        return;
+    }
+
+    if (b.co2_min < a.co2_min) a.co2_min = b.co2_min;
+    if (b.co2_max > a.co2_max) a.co2_max = b.co2_max;
+    if (b.temperature_min < a.temperature_min) a.temperature_min = b.temperature_min;
+    if (b.temperature_max > a.temperature_max) a.temperature_max = b.temperature_max;
+
+    // Sums would overflow, keep mean of samples added before
+    int64_t co2_sum = (int64_t) a.co2_sum + b.co2_sum;
+    int64_t temperature_sum = (int64_t) a.temperature_sum + b.temperature_sum;
+    if (co2_sum != (int32_t) co2_sum || temperature_sum != (int32_t) temperature_sum) {
+        return;
+    }
+    a.co2_sum = co2_sum;
+    a.temperature_sum = temperature_sum;
+    a.count += b.count;
+}
+
+
+/* Add aggregate b into summary a */
+void CRIR_M1_rollup::merge(CRIR_M1_summary &a, const CRIR_M1_aggregate &b) {
+
+    if (a.count == 0) {
+        a.start = b.start;
+        a.co2_min = b.co2_min;
+        a.co2_max = b.co2_max;
+        a.temperature_min = b.temperature_min;
+        a.temperature_max = b.temperature_max;
+        a.co2_sum = 0;
+        a.temperature_sum = 0;
+    }
+
+    if (b.co2_min < a.co2_min) a.co2_min = b.co2_min;
+    if (b.co2_max > a.co2_max) a.co2_max = b.co2_max;
+    if (b.temperature_min < a.temperature_min) a.temperature_min = b.temperature_min;
+    if (b.temperature_max > a.temperature_max) a.temperature_max = b.temperature_max;
+    a.co2_sum += b.co2_sum;
+    a.temperature_sum += b.temperature_sum;
+    a.count += b.count;
+}
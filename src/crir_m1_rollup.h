@@ -0,0 +1,167 @@
+/*******************************************************************
+  CRIR M1 Library - Rollup
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Keep CO2 and temperature trends in fixed memory:
+
+raw samples -> 1 minute -> 15 minutes -> 1 hour -> 1 day
+
+Each tier is a ring of aggregates (min, max, mean and count of a period).
+Aggregates are updated with each sample, the period in progress is kept
+apart and saved in its ring when a sample of a new period arrives.
+Oldest values are overwritten when a ring is full.
+
+Timestamps are in seconds and must not go backwards (older samples are
+ignored), days start at 00:00 UTC with Unix time. Memory used is set with
+CRIR_M1_ROLLUP_*_LEN, defaults keep 1 hour of minutes, 1 day of quarters,
+1 week of hours and 90 days (AVR: 15 minutes, 2 hours, 12 hours and 1
+week). Each aggregate takes 24 bytes, a year of days is 8.8 KB.
+
+Aggregates have 32 bit count and sums. When a sum would overflow (more
+than 2^31 / value samples in one period, for example a day at 1 sample per
+second above 24855 ppm) later samples of that period only update min and
+max, and its mean is the mean of the samples added before. summary()
+merges aggregates into a CRIR_M1_summary with 64 bit sums.
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_ROLLUP
+    #define _CRIR_M1_ROLLUP
+
+    #include "crir_m1.h"
+
+    // RAM used: 8 bytes per raw sample and 24 bytes per aggregate.
+    // Defaults take about 10.5 KB, or 1.2 KB on AVR boards with 2 KB of RAM (UNO, Nano...).
+    #if defined RAMEND && RAMEND < 0x1000
+        #define CRIR_M1_ROLLUP_SMALL
+    #endif
+
+    #ifndef CRIR_M1_ROLLUP_RAW_LEN
+        #ifdef CRIR_M1_ROLLUP_SMALL
+            #define CRIR_M1_ROLLUP_RAW_LEN      12       // Raw samples (96 bytes)
+        #else
+            #define CRIR_M1_ROLLUP_RAW_LEN      60       // Raw samples (480 bytes)
+        #endif
+    #endif
+
+    #ifndef CRIR_M1_ROLLUP_MINUTE_LEN
+        #ifdef CRIR_M1_ROLLUP_SMALL
+            #define CRIR_M1_ROLLUP_MINUTE_LEN   15       // 1 minute aggregates, 15 minutes (360 bytes)
+        #else
+            #define CRIR_M1_ROLLUP_MINUTE_LEN   60       // 1 minute aggregates, 1 hour (1440 bytes)
+        #endif
+    #endif
+
+    #ifndef CRIR_M1_ROLLUP_QUARTER_LEN
+        #ifdef CRIR_M1_ROLLUP_SMALL
+            #define CRIR_M1_ROLLUP_QUARTER_LEN  8        // 15 minutes aggregates, 2 hours (192 bytes)
+        #else
+            #define CRIR_M1_ROLLUP_QUARTER_LEN  96       // 15 minutes aggregates, 1 day (2304 bytes)
+        #endif
+    #endif
+
+    #ifndef CRIR_M1_ROLLUP_HOUR_LEN
+        #ifdef CRIR_M1_ROLLUP_SMALL
+            #define CRIR_M1_ROLLUP_HOUR_LEN     12       // 1 hour aggregates, 12 hours (288 bytes)
+        #else
+            #define CRIR_M1_ROLLUP_HOUR_LEN     168      // 1 hour aggregates, 1 week (4032 bytes)
+        #endif
+    #endif
+
+    #ifndef CRIR_M1_ROLLUP_DAY_LEN
+        #ifdef CRIR_M1_ROLLUP_SMALL
+            #define CRIR_M1_ROLLUP_DAY_LEN      7        // 1 day aggregates, 1 week (168 bytes)
+        #else
+            #define CRIR_M1_ROLLUP_DAY_LEN      90       // 1 day aggregates, 90 days (2160 bytes)
+        #endif
+    #endif
+
+    // Tiers
+    #define CRIR_M1_TIER_MINUTE   (0)
+    #define CRIR_M1_TIER_QUARTER  (1)
+    #define CRIR_M1_TIER_HOUR     (2)
+    #define CRIR_M1_TIER_DAY      (3)
+    #define CRIR_M1_N_TIERS       (4)
+
+
+    struct CRIR_M1_aggregate {
+        uint32_t start;                                                      // Start of period (seconds)
+        uint32_t count;                                                      // Number of samples
+        int16_t co2_min;                                                     // Min CO2 value in ppm
+        int16_t co2_max;                                                     // Max CO2 value in ppm
+        int16_t temperature_min;                                             // Min temperature
+        int16_t temperature_max;                                             // Max temperature
+        int32_t co2_sum;                                                     // Sum of CO2 values
+        int32_t temperature_sum;                                             // Sum of temperatures
+
+        int16_t co2_mean() const { return count ? co2_sum / (int32_t) count : 0; }                // Mean CO2 value
+        int16_t temperature_mean() const { return count ? temperature_sum / (int32_t) count : 0; } // Mean temperature
+    };
+
+    struct CRIR_M1_summary {
+        uint32_t start;                                                      // Start of first period (seconds)
+        uint32_t count;                                                      // Number of samples
+        int16_t co2_min;                                                     // Min CO2 value in ppm
+        int16_t co2_max;                                                     // Max CO2 value in ppm
+        int16_t temperature_min;                                             // Min temperature
+        int16_t temperature_max;                                             // Max temperature
+        int64_t co2_sum;                                                     // Sum of CO2 values
+        int64_t temperature_sum;                                             // Sum of temperatures
+
+        int16_t co2_mean() const { return count ? co2_sum / count : 0; }                          // Mean CO2 value
+        int16_t temperature_mean() const { return count ? temperature_sum / count : 0; }          // Mean temperature
+    };
+
+    class CRIR_M1_rollup
+    {
+        public:
+            CRIR_M1_rollup();                                                                               // Initialize
+            bool add(uint32_t timestamp, int16_t co2, int16_t temperature);                                 // Add sample, false if older than last one
+            uint16_t query_raw(uint32_t from, uint32_t to, CRIR_M1_sample out[], uint16_t max);             // Get raw samples in [from, to)
+            uint16_t query(uint8_t tier, uint32_t from, uint32_t to, CRIR_M1_aggregate out[], uint16_t max); // Get aggregates of a tier which start in [from, to)
+            bool summary(uint8_t tier, uint32_t from, uint32_t to, CRIR_M1_summary &result);                // Merge aggregates of a tier which start in [from, to)
+            void clear();                                                                                   // Remove all data
+
+        private:
+            CRIR_M1_sample raw[CRIR_M1_ROLLUP_RAW_LEN];                                                     // Raw samples
+            CRIR_M1_aggregate minute[CRIR_M1_ROLLUP_MINUTE_LEN];                                            // 1 minute aggregates
+            CRIR_M1_aggregate quarter[CRIR_M1_ROLLUP_QUARTER_LEN];                                          // 15 minutes aggregates
+            CRIR_M1_aggregate hour[CRIR_M1_ROLLUP_HOUR_LEN];                                                // 1 hour aggregates
+            CRIR_M1_aggregate day[CRIR_M1_ROLLUP_DAY_LEN];                                                  // 1 day aggregates
+            CRIR_M1_aggregate open[CRIR_M1_N_TIERS];                                                        // Period in progress of each tier
+            uint16_t raw_head;                                                                              // Index of oldest raw sample
+            uint16_t raw_count;                                                                             // Number of raw samples
+            uint16_t head[CRIR_M1_N_TIERS];                                                                 // Index of oldest aggregate of each tier
+            uint16_t count[CRIR_M1_N_TIERS];                                                                // Number of aggregates of each tier
+            uint32_t last;                                                                                  // Timestamp of last sample
+
+            CRIR_M1_aggregate *items(uint8_t tier);                                                         // Ring of a tier
+            uint16_t size(uint8_t tier);                                                                    // Size of ring of a tier
+            uint16_t first_raw(uint32_t from);                                                              // Position of first raw sample >= from
+            uint16_t first(uint8_t tier, uint32_t from);                                                    // Position of first aggregate >= from
+            void merge(CRIR_M1_aggregate &a, const CRIR_M1_aggregate &b);                                   // Add aggregate b into a
+            void merge(CRIR_M1_summary &a, const CRIR_M1_aggregate &b);                                     // Add aggregate b into summary a
+    };
+
+#endif
@@ -0,0 +1,427 @@
+/*******************************************************************
+  CRIR M1 Library - Sample log
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*******************************************************************/
+
+#include "crir_m1_sample_log.h"
+
+#ifdef CRIR_M1_POSIX
+
+#include "modbus_crc.h"
+#include <stddef.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CRIR_M1_SAMPLE_LOG_PAGE  4096                   // Header size and alignment of areas
+
+// Round up to page size
+static size_t page_round(size_t n) {
+    return (n + CRIR_M1_SAMPLE_LOG_PAGE - 1) / CRIR_M1_SAMPLE_LOG_PAGE * CRIR_M1_SAMPLE_LOG_PAGE;
+}
+
+// Size of a file with given capacity and index stride
+static size_t log_size(uint32_t capacity, uint32_t index_stride) {
+    return CRIR_M1_SAMPLE_LOG_PAGE +
+           page_round(capacity / index_stride * sizeof(CRIR_M1_log_index)) +
+           page_round((size_t) capacity * sizeof(CRIR_M1_log_record));
+}
+
+
+/* Initialize */
+CRIR_M1_sample_log::CRIR_M1_sample_log()
+{
+    fd = -1;
+    writer = false;
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    index = NULL;
+    records = NULL;
+    n_index = 0;
+    head = 1;
+    last = 0;
+}
+
+
+/* Close file */
+CRIR_M1_sample_log::~CRIR_M1_sample_log()
+{
+    close();
+}
+
+
+/* Open or create log to write */
+bool CRIR_M1_sample_log::open(const char *path, uint32_t capacity) {
+
+    close();
+    writer = true;
+    if (!map_file(path, true, capacity)) {
+        close();
+        return false;
+    }
+    recover();
+    return true;
+}
+
+
+/* Open log to read */
+bool CRIR_M1_sample_log::open_reader(const char *path) {
+
+    close();
+    writer = false;
+    if (!map_file(path, false, 0)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+/* Checkpoint (writer) and close file */
+void CRIR_M1_sample_log::close() {
+
+    if (map != NULL) {
+        if (writer) {
+            checkpoint();
+        }
+        munmap(map, map_size);
+    }
+    if (fd >= 0) {
+        ::close(fd);                                    // Releases writer lock
+    }
+
+    fd = -1;
+    writer = false;
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    index = NULL;
+    records = NULL;
+    n_index = 0;
+    head = 1;
+    last = 0;
+}
+
+
+/* Add record */
+bool CRIR_M1_sample_log::append(const CRIR_M1_log_record &record) {
+
+    if (!writer || map == NULL || (head > 1 && record.timestamp < last)) {
+        return false;
+    }
+
+    // Readers must see new head before the overwritten record changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    CRIR_M1_log_record *r = &records[(head - 1) % header->capacity];
+    *r = record;
+    r->seq = head;
+    r->reserved = 0;
+    r->crc = record_crc(r);
+
+    // First record of a block goes to time index
+    if ((head - 1) % header->index_stride == 0) {
+        CRIR_M1_log_index *entry = &index[((head - 1) / header->index_stride) % n_index];
+        __atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        entry->timestamp = record.timestamp;
+        __atomic_store_n(&entry->seq, head, __ATOMIC_RELEASE);
+    }
+
+    last = record.timestamp;
+    head++;
+    __atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+
+    if ((head - 1) % CRIR_M1_SAMPLE_LOG_CHECKPOINT == 0) {
+        checkpoint();
+    }
+
+    return true;
+}
+
+
+/* Sync file and save sequence number */
+bool CRIR_M1_sample_log::checkpoint() {
+
+    if (!writer || map == NULL) {
+        return false;
+    }
+
+    // Records before header, so checkpoint never points after lost records
+    if (msync(map + CRIR_M1_SAMPLE_LOG_PAGE, map_size - CRIR_M1_SAMPLE_LOG_PAGE, MS_SYNC) != 0) {
+        return false;
+    }
+    header->checkpoint = head;
+    return msync(map, CRIR_M1_SAMPLE_LOG_PAGE, MS_SYNC) == 0;
+}
+
+
+/* Oldest record */
+uint32_t CRIR_M1_sample_log::first_seq() {
+
+    if (map == NULL) {
+        return 1;
+    }
+
+    // Record at (next - capacity) may be overwritten now
+    uint32_t next = published();
+    return (next > header->capacity) ? next - header->capacity + 1 : 1;
+}
+
+
+/* Sequence number of next record */
+uint32_t CRIR_M1_sample_log::next_seq() {
+    return (map != NULL) ? published() : 1;
+}
+
+
+/* Record in file */
+const CRIR_M1_log_record *CRIR_M1_sample_log::record(uint32_t seq) {
+
+    if (map == NULL || seq < first_seq() || seq >= published()) {
+        return NULL;
+    }
+
+    const CRIR_M1_log_record *r = &records[(seq - 1) % header->capacity];
+    if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != seq) {
+        return NULL;
+    }
+    return r;
+}
+
+
+/* Record has not been overwritten (call after using it) */
+bool CRIR_M1_sample_log::still_valid(uint32_t seq) {
+
+    if (map == NULL) {
+        return false;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t next = published();
+    return seq < next && next - seq < header->capacity;
+}
+
+
+/* First record with timestamp >= given one (next_seq() if none) */
+uint32_t CRIR_M1_sample_log::seek(uint32_t timestamp) {
+
+    if (map == NULL) {
+        return 1;
+    }
+
+    uint32_t next = published();
+    uint32_t seq = first_seq();
+    if (seq >= next) {
+        return next;
+    }
+
+    // Binary search of last block which starts before timestamp
+    uint32_t stride = header->index_stride;
+    uint32_t low = (seq - 1 + stride - 1) / stride;     // First block not overwritten
+    uint32_t high = (next - 2) / stride + 1;            // After block of last record
+    uint32_t ts;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (!index_entry(mid, ts) || ts < timestamp) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low > 0 && low - 1 >= (seq - 1 + stride - 1) / stride) {
+        seq = (low - 1) * stride + 1;
+    }
+
+    // Records of that block
+    for (; seq < next; seq++) {
+        const CRIR_M1_log_record *r = record(seq);
+        if (r != NULL && r->timestamp >= timestamp) {
+            break;
+        }
+    }
+
+    return seq;
+}
+
+
+/* Number of records of file */
+uint32_t CRIR_M1_sample_log::capacity() {
+    return (map != NULL) ? header->capacity : 0;
+}
+
+
+/* Open and map file */
+bool CRIR_M1_sample_log::map_file(const char *path, bool create, uint32_t capacity) {
+
+    struct stat st;
+
+    fd = ::open(path, create ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Only one writer
+    if (create && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+
+    if (capacity < CRIR_M1_SAMPLE_LOG_INDEX_STRIDE) {
+        capacity = CRIR_M1_SAMPLE_LOG_INDEX_STRIDE;
+    }
+    capacity = (capacity + CRIR_M1_SAMPLE_LOG_INDEX_STRIDE - 1) / CRIR_M1_SAMPLE_LOG_INDEX_STRIDE * CRIR_M1_SAMPLE_LOG_INDEX_STRIDE;
+
+    // New file, or creation stopped by a crash before magic was written (it is written last)
+    bool new_file = false;
+    if (create) {
+        uint32_t magic = 0;
+        new_file = st.st_size == 0 ||
+                   ((size_t) st.st_size == log_size(capacity, CRIR_M1_SAMPLE_LOG_INDEX_STRIDE) &&
+                    pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) && magic == 0);
+    }
+
+    if (new_file) {
+        st.st_size = log_size(capacity, CRIR_M1_SAMPLE_LOG_INDEX_STRIDE);
+        if (ftruncate(fd, st.st_size) != 0) {           // Sparse file filled with zeros
+            return false;
+        }
+    } else if ((size_t) st.st_size < CRIR_M1_SAMPLE_LOG_PAGE) {
+        return false;
+    }
+
+    map_size = st.st_size;
+    void *p = mmap(NULL, map_size, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        map = NULL;
+        return false;
+    }
+    map = (uint8_t *) p;
+    header = (CRIR_M1_log_header *) map;
+
+    if (new_file) {
+        header->version = CRIR_M1_SAMPLE_LOG_VERSION;
+        header->record_size = sizeof(CRIR_M1_log_record);
+        header->capacity = capacity;
+        header->index_stride = CRIR_M1_SAMPLE_LOG_INDEX_STRIDE;
+        header->checkpoint = 1;
+        header->head = 1;
+        if (msync(map, CRIR_M1_SAMPLE_LOG_PAGE, MS_SYNC) != 0) {
+            return false;
+        }
+        header->magic = CRIR_M1_SAMPLE_LOG_MAGIC;           // Saved after other fields
+        if (msync(map, CRIR_M1_SAMPLE_LOG_PAGE, MS_SYNC) != 0) {
+            return false;
+        }
+    }
+
+    if (!valid_header(map_size)) {
+        return false;
+    }
+
+    n_index = header->capacity / header->index_stride;
+    index = (CRIR_M1_log_index *) (map + CRIR_M1_SAMPLE_LOG_PAGE);
+    records = (CRIR_M1_log_record *) (map + CRIR_M1_SAMPLE_LOG_PAGE + page_round(n_index * sizeof(CRIR_M1_log_index)));
+
+    return true;
+}
+
+
+/* Check header of an existing file */
+bool CRIR_M1_sample_log::valid_header(size_t file_size) {
+
+    if (header->magic != CRIR_M1_SAMPLE_LOG_MAGIC || header->version != CRIR_M1_SAMPLE_LOG_VERSION ||
+        header->record_size != sizeof(CRIR_M1_log_record) || header->index_stride == 0 ||
+        header->capacity < header->index_stride || header->capacity % header->index_stride != 0) {
+        return false;
+    }
+
+    return file_size == log_size(header->capacity, header->index_stride);
+}
+
+
+/* Find last valid record from checkpoint */
+void CRIR_M1_sample_log::recover() {
+
+    uint32_t seq = (header->checkpoint > 0) ? header->checkpoint : 1;
+    uint32_t n = 0;
+
+    while (n < header->capacity && valid_record(&records[(seq - 1) % header->capacity], seq)) {
+        const CRIR_M1_log_record *r = &records[(seq - 1) % header->capacity];
+
+        // Index entry may not have been saved
+        if ((seq - 1) % header->index_stride == 0) {
+            CRIR_M1_log_index *entry = &index[((seq - 1) / header->index_stride) % n_index];
+            entry->timestamp = r->timestamp;
+            entry->seq = seq;
+        }
+        seq++;
+        n++;
+    }
+
+    head = seq;
+    last = (head > 1 && valid_record(&records[(head - 2) % header->capacity], head - 1)) ? records[(head - 2) % header->capacity].timestamp : 0;
+    __atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+    checkpoint();
+}
+
+
+/* Record has given sequence number and valid CRC */
+bool CRIR_M1_sample_log::valid_record(const CRIR_M1_log_record *r, uint32_t seq) {
+    return r->seq == seq && r->crc == record_crc(r);
+}
+
+
+/* Timestamp of first record of a block */
+bool CRIR_M1_sample_log::index_entry(uint32_t block, uint32_t &timestamp) {
+
+    const CRIR_M1_log_index *entry = &index[block % n_index];
+    uint32_t seq = block * header->index_stride + 1;
+
+    // Entry may be rewritten while it is read
+    if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != seq) {
+        return false;
+    }
+    timestamp = entry->timestamp;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq;
+}
+
+
+/* CRC16 of record */
+uint16_t CRIR_M1_sample_log::record_crc(const CRIR_M1_log_record *r) {
+    return modbus_CRC16((unsigned char *) r, offsetof(CRIR_M1_log_record, crc));
+}
+
+
+/* Next sequence number written by writer */
+uint32_t CRIR_M1_sample_log::published() {
+    return writer ? head : __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*******************************************************************
+  CRIR M1 Library - Sample log
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Append-only log of readings in a memory mapped file of fixed size, for
+Linux gateways (not available on Arduino):
+
+header page | time index | records (ring)
+
+Each record gets a sequence number (1, 2, 3...) and a CRC16, record n is
+saved at position (n - 1) % capacity, so oldest records are overwritten
+when the file is full. Timestamps must not go backwards.
+
+One process writes:
+
+CRIR_M1_sample_log log;
+log.open("/var/lib/co2/samples.log", 100000);
+CRIR_M1_log_record r = {};
+r.sensor_id = sensor.get_sensor_ID();
+r.timestamp = time(NULL);
+r.status = sensor.get_co2(r.co2);
+log.append(r);
+
+Any number of processes read at the same time, records are used in place:
+
+log.open_reader("/var/lib/co2/samples.log");
+for (uint32_t seq = log.seek(from); seq < log.next_seq(); seq++) {
+    const CRIR_M1_log_record *r = log.record(seq);
+    ...
+    if (!log.still_valid(seq)) ...    // Overwritten while it was used
+}
+
+Every CRIR_M1_SAMPLE_LOG_CHECKPOINT records the file is synced and the
+sequence number saved in the header (checkpoint). After a crash, open()
+checks records from the last checkpoint and stops at the first one with
+wrong sequence number or CRC, so only the records after the checkpoint are
+read. If the writer stopped while creating the file (magic of header still
+0), open() with the same capacity creates it again. Every
+CRIR_M1_SAMPLE_LOG_INDEX_STRIDE records, sequence number and
+timestamp are saved in the time index, seek() searches it first.
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_SAMPLE_LOG
+    #define _CRIR_M1_SAMPLE_LOG
+
+    #include "crir_m1.h"
+
+    #ifdef CRIR_M1_POSIX
+
+    #ifndef CRIR_M1_SAMPLE_LOG_INDEX_STRIDE
+        #define CRIR_M1_SAMPLE_LOG_INDEX_STRIDE  64      // Records between entries of time index
+    #endif
+
+    #ifndef CRIR_M1_SAMPLE_LOG_CHECKPOINT
+        #define CRIR_M1_SAMPLE_LOG_CHECKPOINT    256     // Records between checkpoints
+    #endif
+
+    #define CRIR_M1_SAMPLE_LOG_MAGIC    0x4C4D3143UL     // "C1ML"
+    #define CRIR_M1_SAMPLE_LOG_VERSION  1
+
+
+    struct CRIR_M1_log_record {
+        uint32_t seq;                                                        // Sequence number (0 if empty)
+        uint32_t timestamp;                                                  // Time of reading (seconds)
+        int32_t sensor_id;                                                   // Sensor ID (get_sensor_ID)
+        int16_t co2;                                                         // CO2 value in ppm
+        int16_t temperature;                                                 // Temperature in celsius degree
+        int16_t meter_status;                                                // Meter status
+        int16_t output_status;                                               // Output status
+        uint8_t status;                                                      // Status of request (CRIR_M1_OK...)
+        uint8_t reserved;
+        uint16_t crc;                                                        // CRC16 of previous bytes
+    };
+
+    struct CRIR_M1_log_header {
+        uint32_t magic;                                                      // CRIR_M1_SAMPLE_LOG_MAGIC
+        uint16_t version;                                                    // CRIR_M1_SAMPLE_LOG_VERSION
+        uint16_t record_size;                                                // Size of a record
+        uint32_t capacity;                                                   // Number of records
+        uint32_t index_stride;                                               // Records between entries of time index
+        uint32_t checkpoint;                                                 // Next sequence number at last checkpoint
+        uint32_t head;                                                       // Next sequence number
+    };
+
+    struct CRIR_M1_log_index {
+        uint32_t seq;                                                        // First record of a block
+        uint32_t timestamp;                                                  // Timestamp of that record
+    };
+
+    class CRIR_M1_sample_log
+    {
+        public:
+            CRIR_M1_sample_log();                                                         // Initialize
+            ~CRIR_M1_sample_log();                                                        // Close file
+            bool open(const char *path, uint32_t capacity);                               // Open or create log to write (capacity only used to create it)
+            bool open_reader(const char *path);                                           // Open log to read
+            void close();                                                                 // Checkpoint (writer) and close file
+            bool append(const CRIR_M1_log_record &record);                                // Add record, false if older than last one
+            bool checkpoint();                                                            // Sync file and save sequence number
+            uint32_t first_seq();                                                         // Oldest record
+            uint32_t next_seq();                                                          // Sequence number of next record
+            const CRIR_M1_log_record *record(uint32_t seq);                               // Record in file, NULL if not available
+            bool still_valid(uint32_t seq);                                               // Record has not been overwritten
+            uint32_t seek(uint32_t timestamp);                                            // First record with timestamp >= given one
+            uint32_t capacity();                                                          // Number of records of file
+
+        private:
+            int fd;                                                                       // File descriptor (locked by writer), -1 if closed
+            bool writer;                                                                  // Opened to write
+            uint8_t *map;                                                                 // Mapped file
+            size_t map_size;                                                              // Size of mapped file
+            CRIR_M1_log_header *header;                                                   // Header in file
+            CRIR_M1_log_index *index;                                                     // Time index in file
+            CRIR_M1_log_record *records;                                                  // Records in file
+            uint32_t n_index;                                                             // Entries of time index
+            uint32_t head;                                                                // Next sequence number (writer)
+            uint32_t last;                                                                // Timestamp of last record (writer)
+
+            bool map_file(const char *path, bool create, uint32_t capacity);              // Open and map file
+            bool valid_header(size_t file_size);                                          // Check header of an existing file
+            void recover();                                                               // Find last valid record from checkpoint
+            bool valid_record(const CRIR_M1_log_record *r, uint32_t seq);                 // Record has given sequence number and valid CRC
+            bool index_entry(uint32_t block, uint32_t &timestamp);                        // Timestamp of first record of a block, false if not available
+            uint16_t record_crc(const CRIR_M1_log_record *r);                             // CRC16 of record
+            uint32_t published();                                                         // Next sequence number written by writer
+    };
+
+    #endif
+
+#endif
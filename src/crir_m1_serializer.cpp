@@ -0,0 +1,351 @@
+/*******************************************************************
+  CRIR M1 Library - Serializer
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*******************************************************************/
+
+#include "crir_m1_serializer.h"
+
+// CBOR major types
+#define CBOR_UNSIGNED  (0)
+#define CBOR_NEGATIVE  (1)
+#define CBOR_TEXT      (3)
+#define CBOR_ARRAY     (4)
+#define CBOR_MAP       (5)
+
+
+/* Initialize writing into buffer */
+CRIR_M1_serializer::CRIR_M1_serializer(uint8_t *buffer, size_t size)
+{
+#ifdef ARDUINO
+    out = NULL;
+#endif
+    buf = buffer;
+    this->size = (buffer != NULL) ? size : 0;
+    len = 0;
+    full = false;
+}
+
+
+#ifdef ARDUINO
+/* Initialize writing into Print */
+CRIR_M1_serializer::CRIR_M1_serializer(Print &out)
+{
+    this->out = &out;
+    buf = NULL;
+    size = 0;
+    len = 0;
+    full = false;
+}
+#endif
+
+
+/* Write sensor values */
+size_t CRIR_M1_serializer::write_snapshot(const CRIR_M1_sensor &sensor, uint8_t format) {
+
+    size_t start = len;
+
+    switch (format) {
+        case CRIR_M1_FORMAT_CSV:
+            put_csv_str(sensor.sn);
+            put_char(',');
+            put_csv_str(sensor.softver);
+            put_char(',');
+            put_int(sensor.co2);
+            put_char(',');
+            put_int(sensor.temperature);
+            put_char('\n');
+            break;
+
+        case CRIR_M1_FORMAT_JSON:
+            put_str("{\"sn\":");
+            put_json_str(sensor.sn);
+            put_str(",\"softver\":");
+            put_json_str(sensor.softver);
+            put_str(",\"co2\":");
+            put_int(sensor.co2);
+            put_str(",\"temperature\":");
+            put_int(sensor.temperature);
+            put_char('}');
+            break;
+
+        case CRIR_M1_FORMAT_CBOR:
+            put_cbor_head(CBOR_MAP, 4);
+            put_cbor_str("sn");
+            put_cbor_str(sensor.sn);
+            put_cbor_str("softver");
+            put_cbor_str(sensor.softver);
+            put_cbor_str("co2");
+            put_cbor_int(sensor.co2);
+            put_cbor_str("temperature");
+            put_cbor_int(sensor.temperature);
+            break;
+    }
+
+    // Do not leave half record in buffer
+    if (full) {
+        len = start;
+        return 0;
+    }
+
+    return len - start;
+}
+
+
+/* Write samples */
+size_t CRIR_M1_serializer::write_history(const CRIR_M1_sample samples[], uint16_t count, uint8_t format) {
+
+    size_t start = len;
+
+    if (samples == NULL) {
+        count = 0;
+    }
+
+    switch (format) {
+        case CRIR_M1_FORMAT_CSV:
+            for (uint16_t i = 0; i < count; i++) {
+                put_uint(samples[i].timestamp);
+                put_char(',');
+                put_int(samples[i].co2);
+                put_char(',');
+                put_int(samples[i].temperature);
+                put_char('\n');
+            }
+            break;
+
+        case CRIR_M1_FORMAT_JSON:
+            put_char('[');
+            for (uint16_t i = 0; i < count; i++) {
+                if (i > 0) {
+                    put_char(',');
+                }
+                put_str("{\"timestamp\":");
+                put_uint(samples[i].timestamp);
+                put_str(",\"co2\":");
+                put_int(samples[i].co2);
+                put_str(",\"temperature\":");
+                put_int(samples[i].temperature);
+                put_char('}');
+            }
+            put_char(']');
+            break;
+
+        case CRIR_M1_FORMAT_CBOR:
+            put_cbor_head(CBOR_ARRAY, count);
+            for (uint16_t i = 0; i < count; i++) {
+                put_cbor_head(CBOR_MAP, 3);
+                put_cbor_str("timestamp");
+                put_cbor_head(CBOR_UNSIGNED, samples[i].timestamp);
+                put_cbor_str("co2");
+                put_cbor_int(samples[i].co2);
+                put_cbor_str("temperature");
+                put_cbor_int(samples[i].temperature);
+            }
+            break;
+    }
+
+    // Do not leave half record in buffer
+    if (full) {
+        len = start;
+        return 0;
+    }
+
+    return len - start;
+}
+
+
+/* Total bytes written */
+size_t CRIR_M1_serializer::length() {
+    return len;
+}
+
+
+/* Buffer was too small */
+bool CRIR_M1_serializer::overflow() {
+    return full;
+}
+
+
+/* Start again at beginning of buffer */
+void CRIR_M1_serializer::reset() {
+    len = 0;
+    full = false;
+}
+
+
+/* Write bytes */
+void CRIR_M1_serializer::put(const uint8_t *data, size_t n) {
+
+#ifdef ARDUINO
+    if (out != NULL) {
+        len += out->write(data, n);
+        return;
+    }
+#endif
+    if (!full) {
+        if (n <= size - len) {
+            memcpy(&buf[len], data, n);
+            len += n;
+        } else {
+            full = true;
+        }
+    }
+}
+
+
+/* Write one character */
+void CRIR_M1_serializer::put_char(char c) {
+    put((const uint8_t *) &c, 1);
+}
+
+
+/* Write string as is */
+void CRIR_M1_serializer::put_str(const char *str) {
+    put((const uint8_t *) str, strlen(str));
+}
+
+
+/* Write integer in decimal */
+void CRIR_M1_serializer::put_int(int32_t value) {
+
+    if (value < 0) {
+        put_char('-');
+        put_uint((uint32_t) 0 - (uint32_t) value);
+    } else {
+        put_uint(value);
+    }
+}
+
+
+/* Write unsigned integer in decimal */
+void CRIR_M1_serializer::put_uint(uint32_t value) {
+
+    char digits[10];
+    uint8_t pos = sizeof(digits);
+
+    do {
+        digits[--pos] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    put((const uint8_t *) &digits[pos], sizeof(digits) - pos);
+}
+
+
+/* Write JSON string with quotes and escapes */
+void CRIR_M1_serializer::put_json_str(const char *str) {
+
+    static const char hex[] = "0123456789abcdef";
+    const char *start = str;
+
+    put_char('"');
+
+    // Copy runs of plain characters at once
+    for (; *str != '\0'; str++) {
+        uint8_t c = *str;
+        if (c == '"' || c == '\\' || c < 0x20) {
+            put((const uint8_t *) start, str - start);
+            if (c == '"' || c == '\\') {
+                char esc[2] = { '\\', (char) c };
+                put((const uint8_t *) esc, 2);
+            } else {
+                char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+                put((const uint8_t *) esc, 6);
+            }
+            start = str + 1;
+        }
+    }
+    put((const uint8_t *) start, str - start);
+
+    put_char('"');
+}
+
+
+/* Write CSV field, quoted if needed */
+void CRIR_M1_serializer::put_csv_str(const char *str) {
+
+    if (strpbrk(str, ",\"\r\n") == NULL) {
+        put_str(str);
+        return;
+    }
+
+    put_char('"');
+    for (; *str != '\0'; str++) {
+        if (*str == '"') {
+            put_char('"');
+        }
+        put_char(*str);
+    }
+    put_char('"');
+}
+
+
+/* Write CBOR type and argument */
+void CRIR_M1_serializer::put_cbor_head(uint8_t major, uint32_t value) {
+
+    uint8_t head[5];
+    uint8_t n;
+
+    major <<= 5;
+    if (value < 24) {
+        head[0] = major | value;
+        n = 1;
+    } else if (value <= 0xFF) {
+        head[0] = major | 24;
+        head[1] = value;
+        n = 2;
+    } else if (value <= 0xFFFF) {
+        head[0] = major | 25;
+        head[1] = (value >> 8) & 0xFF;
+        head[2] = value & 0xFF;
+        n = 3;
+    } else {
+        head[0] = major | 26;
+        head[1] = (value >> 24) & 0xFF;
+        head[2] = (value >> 16) & 0xFF;
+        head[3] = (value >> 8) & 0xFF;
+        head[4] = value & 0xFF;
+        n = 5;
+    }
+    put(head, n);
+}
+
+
+/* Write CBOR integer */
+void CRIR_M1_serializer::put_cbor_int(int32_t value) {
+
+    if (value >= 0) {
+        put_cbor_head(CBOR_UNSIGNED, value);
+    } else {
+        put_cbor_head(CBOR_NEGATIVE, (uint32_t) (-1 - value));
+    }
+}
+
+
+/* Write CBOR text string */
+void CRIR_M1_serializer::put_cbor_str(const char *str) {
+
+    size_t n = strlen(str);
+
+    put_cbor_head(CBOR_TEXT, n);
+    put((const uint8_t *) str, n);
+}
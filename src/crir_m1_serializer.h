@@ -0,0 +1,88 @@
+/*******************************************************************
+  CRIR M1 Library - Serializer
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Serialize readings in CSV, JSON or CBOR without heap use, into a buffer
+given by the caller or directly into a Print (Serial, WiFiClient...).
+
+Snapshot (CRIR_M1_sensor):
+  CSV  -> sn,softver,co2,temperature\n
+  JSON -> {"sn":"...","softver":"...","co2":450,"temperature":23}
+  CBOR -> map with the same keys
+
+History (array of CRIR_M1_sample):
+  CSV  -> timestamp,co2,temperature\n for each sample
+  JSON -> [{"timestamp":...,"co2":...,"temperature":...},...]
+  CBOR -> array of maps with the same keys
+
+Buffer is not NUL terminated, use length() to get written bytes. A snapshot
+or history that does not fit is not written at all: 0 is returned and
+overflow() is true until reset().
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_SERIALIZER
+    #define _CRIR_M1_SERIALIZER
+
+    #include "crir_m1.h"
+
+    #define CRIR_M1_FORMAT_CSV   (0)
+    #define CRIR_M1_FORMAT_JSON  (1)
+    #define CRIR_M1_FORMAT_CBOR  (2)
+
+    class CRIR_M1_serializer
+    {
+        public:
+            CRIR_M1_serializer(uint8_t *buffer, size_t size);                                     // Write into buffer
+#ifdef ARDUINO
+            CRIR_M1_serializer(Print &out);                                                       // Write into Print
+#endif
+            size_t write_snapshot(const CRIR_M1_sensor &sensor, uint8_t format);                  // Write sensor values, returns bytes written
+            size_t write_history(const CRIR_M1_sample samples[], uint16_t count, uint8_t format); // Write samples, returns bytes written
+            size_t length();                                                                      // Total bytes written
+            bool overflow();                                                                      // Buffer was too small
+            void reset();                                                                         // Start again at beginning of buffer
+
+        private:
+#ifdef ARDUINO
+            Print *out;                                                                           // Output, NULL if buffer is used
+#endif
+            uint8_t *buf;                                                                         // Output buffer
+            size_t size;                                                                          // Size of output buffer
+            size_t len;                                                                           // Bytes written
+            bool full;                                                                            // Buffer overflow
+
+            void put(const uint8_t *data, size_t n);                                              // Write bytes
+            void put_char(char c);                                                                // Write one character
+            void put_str(const char *str);                                                        // Write string as is
+            void put_int(int32_t value);                                                          // Write integer in decimal
+            void put_uint(uint32_t value);                                                        // Write unsigned integer in decimal
+            void put_json_str(const char *str);                                                   // Write JSON string with quotes and escapes
+            void put_csv_str(const char *str);                                                    // Write CSV field, quoted if needed
+            void put_cbor_head(uint8_t major, uint32_t value);                                    // Write CBOR type and argument
+            void put_cbor_int(int32_t value);                                                     // Write CBOR integer
+            void put_cbor_str(const char *str);                                                   // Write CBOR text string
+    };
+
+#endif
@@ -0,0 +1,353 @@
+/*******************************************************************
+  CRIR M1 Library - Shared memory
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*******************************************************************/
+
+#include "crir_m1_shm.h"
+
+#ifdef CRIR_M1_POSIX
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of a segment
+static size_t segment_size(uint32_t n_slots) {
+    return sizeof(CRIR_M1_shm_header) + (size_t) n_slots * sizeof(CRIR_M1_shm_slot);
+}
+
+
+// Clear magic of a segment before it is removed, readers still mapping it see it is stale
+static void retire_segment(int fd) {
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CRIR_M1_shm_header)) {
+        return;
+    }
+
+    void *p = mmap(NULL, sizeof(CRIR_M1_shm_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        return;
+    }
+    CRIR_M1_shm_header *h = (CRIR_M1_shm_header *) p;
+    if (__atomic_load_n(&h->magic, __ATOMIC_RELAXED) == CRIR_M1_SHM_MAGIC) {
+        __atomic_store_n(&h->magic, 0, __ATOMIC_RELEASE);
+    }
+    munmap(p, sizeof(CRIR_M1_shm_header));
+}
+
+
+/* Initialize */
+CRIR_M1_shm_publisher::CRIR_M1_shm_publisher()
+{
+    fd = -1;
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    slot_list = NULL;
+    n_slots = 0;
+}
+
+
+/* Close segment */
+CRIR_M1_shm_publisher::~CRIR_M1_shm_publisher()
+{
+    close();
+}
+
+
+/* Create or open segment */
+bool CRIR_M1_shm_publisher::open(const char *name, uint32_t n_slots) {
+
+    struct stat st;
+
+    close();
+
+    if (n_slots == 0) {
+        return false;
+    }
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Only one publisher
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+
+    // Same layout, keep last values
+    size_t size = segment_size(n_slots);
+    if ((size_t) st.st_size == size && map_segment(size) &&
+        header->magic == CRIR_M1_SHM_MAGIC && header->version == CRIR_M1_SHM_VERSION &&
+        header->slot_size == sizeof(CRIR_M1_shm_slot) && header->n_slots == n_slots) {
+
+        // Last publisher may have stopped while writing a slot, its values
+        // can be torn, so the slot is cleared and marked as never published
+        for (uint32_t i = 0; i < n_slots; i++) {
+            if (__atomic_load_n(&slot_list[i].seq, __ATOMIC_RELAXED) & 1) {
+                for (uint8_t j = 0; j < CRIR_M1_SHM_WORDS; j++) {
+                    __atomic_store_n(&slot_list[i].words[j], 0, __ATOMIC_RELAXED);
+                }
+                __atomic_store_n(&slot_list[i].seq, 0, __ATOMIC_RELEASE);
+            }
+        }
+        this->n_slots = n_slots;
+        return true;
+    }
+
+    // Other layout, readers keep old segment mapped, so it is replaced instead of changed
+    if (st.st_size != 0) {
+        retire_segment(fd);
+        close();
+        if (shm_unlink(name) != 0) {
+            return false;
+        }
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close();
+            return false;
+        }
+    }
+
+    // New segment filled with zeros
+    if (ftruncate(fd, size) != 0 || !map_segment(size)) {
+        close();
+        return false;
+    }
+    header->version = CRIR_M1_SHM_VERSION;
+    header->slot_size = sizeof(CRIR_M1_shm_slot);
+    header->n_slots = n_slots;
+    __atomic_store_n(&header->magic, CRIR_M1_SHM_MAGIC, __ATOMIC_RELEASE);
+    this->n_slots = n_slots;
+
+    return true;
+}
+
+
+/* Map segment of descriptor */
+bool CRIR_M1_shm_publisher::map_segment(size_t size) {
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    map = (uint8_t *) p;
+    map_size = size;
+    header = (CRIR_M1_shm_header *) map;
+    slot_list = (CRIR_M1_shm_slot *) (map + sizeof(CRIR_M1_shm_header));
+    return true;
+}
+
+
+/* Close segment, readers keep last values */
+void CRIR_M1_shm_publisher::close() {
+
+    if (map != NULL) {
+        munmap(map, map_size);
+    }
+    if (fd >= 0) {
+        ::close(fd);                                    // Releases publisher lock
+    }
+
+    fd = -1;
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    slot_list = NULL;
+    n_slots = 0;
+}
+
+
+/* Write reading of a sensor */
+bool CRIR_M1_shm_publisher::publish(uint32_t slot, const CRIR_M1_shm_reading &reading) {
+
+    uint32_t words[CRIR_M1_SHM_WORDS];
+
+    if (map == NULL || slot >= n_slots) {
+        return false;
+    }
+
+    CRIR_M1_shm_slot *s = &slot_list[slot];
+    uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+
+    memcpy(words, &reading, sizeof(words));
+
+    // Odd while writing
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (uint8_t i = 0; i < CRIR_M1_SHM_WORDS; i++) {
+        __atomic_store_n(&s->words[i], words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+
+/* Remove segment, readers see it is stale */
+bool CRIR_M1_shm_publisher::remove(const char *name) {
+
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd >= 0) {
+        retire_segment(fd);
+        ::close(fd);
+    }
+    return shm_unlink(name) == 0;
+}
+
+
+/* Initialize */
+CRIR_M1_shm_reader::CRIR_M1_shm_reader()
+{
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    slot_list = NULL;
+    n_slots = 0;
+}
+
+
+/* Close segment */
+CRIR_M1_shm_reader::~CRIR_M1_shm_reader()
+{
+    close();
+}
+
+
+/* Open segment */
+bool CRIR_M1_shm_reader::open(const char *name) {
+
+    struct stat st;
+
+    close();
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CRIR_M1_shm_header)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Mapping stays valid after closing descriptor
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    map = (uint8_t *) p;
+    map_size = st.st_size;
+    header = (CRIR_M1_shm_header *) map;
+    slot_list = (CRIR_M1_shm_slot *) (map + sizeof(CRIR_M1_shm_header));
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != CRIR_M1_SHM_MAGIC || header->version != CRIR_M1_SHM_VERSION ||
+        header->slot_size != sizeof(CRIR_M1_shm_slot) || segment_size(header->n_slots) != map_size) {
+        close();
+        return false;
+    }
+
+    // Header could change later, slots are always checked against mapping
+    n_slots = (map_size - sizeof(CRIR_M1_shm_header)) / sizeof(CRIR_M1_shm_slot);
+
+    return true;
+}
+
+
+/* Close segment */
+void CRIR_M1_shm_reader::close() {
+
+    if (map != NULL) {
+        munmap(map, map_size);
+    }
+
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    slot_list = NULL;
+    n_slots = 0;
+}
+
+
+/* Get last reading, false if none, slot busy or segment stale (reading is not changed) */
+bool CRIR_M1_shm_reader::read(uint32_t slot, CRIR_M1_shm_reading &reading) {
+
+    uint32_t words[CRIR_M1_SHM_WORDS];
+
+    if (map == NULL || slot >= n_slots || stale()) {
+        return false;
+    }
+
+    const CRIR_M1_shm_slot *s = &slot_list[slot];
+
+    for (uint8_t n = 0; n < CRIR_M1_SHM_READ_RETRIES; n++) {
+        uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq == 0) {
+            return false;                               // Never published
+        }
+        if (seq & 1) {
+            continue;                                   // Publisher is writing
+        }
+
+        for (uint8_t i = 0; i < CRIR_M1_SHM_WORDS; i++) {
+            words[i] = __atomic_load_n(&s->words[i], __ATOMIC_RELAXED);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+            memcpy(&reading, words, sizeof(words));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* Number of readings published in slot */
+uint32_t CRIR_M1_shm_reader::updates(uint32_t slot) {
+
+    if (map == NULL || slot >= n_slots) {
+        return 0;
+    }
+    return __atomic_load_n(&slot_list[slot].seq, __ATOMIC_ACQUIRE) / 2;
+}
+
+
+/* Number of slots */
+uint32_t CRIR_M1_shm_reader::slots() {
+    return n_slots;
+}
+
+
+/* Segment was replaced or removed, open it again */
+bool CRIR_M1_shm_reader::stale() {
+    return map != NULL && __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != CRIR_M1_SHM_MAGIC;
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*******************************************************************
+  CRIR M1 Library - Shared memory
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Latest readings of many sensors in POSIX shared memory, for Linux gateways
+(not available on Arduino). One process owns the serial ports and
+publishes, any number of processes read:
+
+CRIR_M1_shm_publisher pub;                  CRIR_M1_shm_reader sub;
+pub.open("/crir_m1", 8);                    sub.open("/crir_m1");
+CRIR_M1_shm_reading r = {};                 CRIR_M1_shm_reading r;
+r.status = sensor.get_co2(r.co2);           if (sub.read(0, r)) {
+pub.publish(0, r);                              ...
+                                            }
+
+Each sensor has a slot of one cache line protected by a sequence lock:
+the publisher makes the sequence number odd, writes the values and makes
+it even again. Readers copy the values and retry if the sequence number was
+odd or has changed, so they never block the publisher and never make
+system calls after open(). read() gives up after CRIR_M1_SHM_READ_RETRIES
+tries (publisher writing all the time).
+
+When the publisher opens a segment with another number of slots, the
+segment is removed and created again. Its magic number is cleared first, so
+readers still mapping the old one get false from read() and true from
+stale() until they open it again. Slots left odd by a publisher that
+stopped while writing are cleared when the segment is opened again, they
+read as never published.
+
+Link with -lrt on old glibc versions.
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_SHM
+    #define _CRIR_M1_SHM
+
+    #include "crir_m1.h"
+
+    #ifdef CRIR_M1_POSIX
+
+    #ifndef CRIR_M1_SHM_READ_RETRIES
+        #define CRIR_M1_SHM_READ_RETRIES  64         // Tries of a read while slot is being written
+    #endif
+
+    #define CRIR_M1_SHM_MAGIC    0x534D3143UL        // "C1MS"
+    #define CRIR_M1_SHM_VERSION  1
+
+
+    struct CRIR_M1_shm_reading {
+        int32_t sensor_id;                                                   // Sensor ID (get_sensor_ID)
+        uint32_t timestamp;                                                  // Time of reading (seconds)
+        int16_t co2;                                                         // CO2 value in ppm
+        int16_t temperature;                                                 // Temperature in celsius degree
+        int16_t meter_status;                                                // Meter status
+        int16_t output_status;                                               // Output status
+        uint8_t status;                                                      // Status of request (CRIR_M1_OK...)
+        uint8_t link;                                                        // Link state (CRIR_M1_LINK_HEALTHY...)
+        uint16_t reserved;
+    };
+
+    #define CRIR_M1_SHM_WORDS  (sizeof(CRIR_M1_shm_reading) / 4)
+
+    struct CRIR_M1_shm_slot {
+        uint32_t seq;                                                        // Sequence lock, odd while writing
+        uint32_t words[CRIR_M1_SHM_WORDS];                                   // Reading
+        uint8_t pad[64 - 4 - 4 * CRIR_M1_SHM_WORDS];                         // One slot per cache line
+    };
+
+    struct CRIR_M1_shm_header {
+        uint32_t magic;                                                      // CRIR_M1_SHM_MAGIC, 0 when replaced or removed
+        uint16_t version;                                                    // CRIR_M1_SHM_VERSION
+        uint16_t slot_size;                                                  // Size of a slot
+        uint32_t n_slots;                                                    // Number of slots
+        uint8_t pad[64 - 12];
+    };
+
+    class CRIR_M1_shm_publisher
+    {
+        public:
+            CRIR_M1_shm_publisher();                                                      // Initialize
+            ~CRIR_M1_shm_publisher();                                                     // Close segment
+            bool open(const char *name, uint32_t n_slots);                                // Create or open segment (only one publisher)
+            void close();                                                                 // Close segment, readers keep last values
+            bool publish(uint32_t slot, const CRIR_M1_shm_reading &reading);              // Write reading of a sensor
+            static bool remove(const char *name);                                         // Remove segment, readers see it is stale
+
+        private:
+            int fd;                                                                       // Segment descriptor (locked), -1 if closed
+            uint8_t *map;                                                                 // Mapped segment
+            size_t map_size;                                                              // Size of mapped segment
+            CRIR_M1_shm_header *header;                                                   // Header in segment
+            CRIR_M1_shm_slot *slot_list;                                                  // Slots in segment
+            uint32_t n_slots;                                                             // Number of slots
+
+            bool map_segment(size_t size);                                                // Map segment of descriptor
+    };
+
+    class CRIR_M1_shm_reader
+    {
+        public:
+            CRIR_M1_shm_reader();                                                         // Initialize
+            ~CRIR_M1_shm_reader();                                                        // Close segment
+            bool open(const char *name);                                                  // Open segment
+            void close();                                                                 // Close segment
+            bool read(uint32_t slot, CRIR_M1_shm_reading &reading);                       // Get last reading, false if none, slot busy or segment stale
+            uint32_t updates(uint32_t slot);                                              // Number of readings published in slot
+            uint32_t slots();                                                             // Number of slots
+            bool stale();                                                                 // Segment was replaced or removed, open it again
+
+        private:
+            uint8_t *map;                                                                 // Mapped segment
+            size_t map_size;                                                              // Size of mapped segment
+            CRIR_M1_shm_header *header;                                                   // Header in segment
+            CRIR_M1_shm_slot *slot_list;                                                  // Slots in segment
+            uint32_t n_slots;                                                             // Number of slots when opened (fits in mapping)
+    };
+
+    #endif
+
+#endif
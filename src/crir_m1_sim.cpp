@@ -0,0 +1,299 @@
+/*******************************************************************
+  CRIR M1 Library - Simulator
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*******************************************************************/
+
+#include "crir_m1_sim.h"
+#include "modbus_crc.h"
+
+#if defined ARDUINO || defined CRIR_M1_POSIX
+
+#define CRIR_M1_SIM_N_INPUT_REG    (MODBUS_IR20 + 1)
+#define CRIR_M1_SIM_N_HOLDING_REG  (MODBUS_HR8 + 1)
+
+
+#ifndef ARDUINO
+// Time in microseconds
+static unsigned long micros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+#endif
+
+
+/* Initialize */
+CRIR_M1_simulator::CRIR_M1_simulator()
+{
+    const char sn[CRIR_M1_LEN_SN + 1] = "SIMULATED0";
+
+    memset(input_reg, 0, sizeof(input_reg));
+    memset(holding_reg, 0, sizeof(holding_reg));
+
+    input_reg[MODBUS_IR10] = 0x0000;                // Sensor type ID
+    input_reg[MODBUS_IR11] = 0x0001;
+    input_reg[MODBUS_IR12] = 0x0001;                // Memory map version
+    input_reg[MODBUS_IR13] = 0x0102;                // Firmware 1.2
+    for (uint8_t i = 0; i < CRIR_M1_LEN_SN / 2; i++) {  // Serial number
+        input_reg[MODBUS_IR16 + i] = (sn[i * 2] << 8) | sn[i * 2 + 1];
+    }
+    holding_reg[MODBUS_HR5] = 180;                  // ABC period
+    holding_reg[MODBUS_HR8] = 400;                  // User concentration
+
+    set_co2(400);
+    set_temperature(25);
+
+    req_len = 0;
+    ans_len = 0;
+    ans_read = 0;
+    ans_start = 0;
+    delay_us = 0;
+    drop_rate = 0;
+    fifo_len = CRIR_M1_SIM_FIFO_LEN;
+    seed = 12345;
+    lost = 0;
+}
+
+
+/* Set CO2 value in ppm */
+void CRIR_M1_simulator::set_co2(int16_t co2) {
+    input_reg[MODBUS_IR8] = co2;
+}
+
+
+/* Set temperature in celsius degree */
+void CRIR_M1_simulator::set_temperature(int16_t temperature) {
+    input_reg[MODBUS_IR5] = (temperature + 100) * 100;
+}
+
+
+/* Set meter status */
+void CRIR_M1_simulator::set_meter_status(int16_t status) {
+    input_reg[MODBUS_IR6] = status;
+}
+
+
+/* Set output status */
+void CRIR_M1_simulator::set_output_status(int16_t status) {
+    input_reg[MODBUS_IR7] = status;
+}
+
+
+/* Set sensor ID */
+void CRIR_M1_simulator::set_sensor_ID(int32_t id) {
+    input_reg[MODBUS_IR14] = (id >> 16) & 0xFFFF;
+    input_reg[MODBUS_IR15] = id & 0xFFFF;
+}
+
+
+/* Time sensor needs to answer */
+void CRIR_M1_simulator::set_response_delay(uint32_t us) {
+    delay_us = us;
+}
+
+
+/* Requests without answer (percent) */
+void CRIR_M1_simulator::set_drop_rate(uint8_t percent) {
+    drop_rate = (percent > 100) ? 100 : percent;
+}
+
+
+/* Size of receive FIFO (1 - CRIR_M1_SIM_FIFO_LEN bytes) */
+void CRIR_M1_simulator::set_fifo_len(uint8_t len) {
+    fifo_len = (len < 1) ? 1 : (len > CRIR_M1_SIM_FIFO_LEN) ? CRIR_M1_SIM_FIFO_LEN : len;
+}
+
+
+/* Bytes lost because they were not read in time */
+uint32_t CRIR_M1_simulator::overruns() {
+    arrived();
+    return lost;
+}
+
+
+/* Bytes available to read */
+int CRIR_M1_simulator::available() {
+    return arrived() - ans_read;
+}
+
+
+/* Read one byte */
+int CRIR_M1_simulator::read() {
+
+    if (arrived() == ans_read) {
+        return -1;
+    }
+    return ans[ans_read++];
+}
+
+
+/* Read one byte without removing it */
+int CRIR_M1_simulator::peek() {
+
+    if (arrived() == ans_read) {
+        return -1;
+    }
+    return ans[ans_read];
+}
+
+
+/* Receive one byte of request */
+size_t CRIR_M1_simulator::write(uint8_t data) {
+
+    req[req_len++] = data;
+    if (req_len == sizeof(req)) {
+        answer();
+        req_len = 0;
+    }
+    return 1;
+}
+
+
+/* Requests are processed when they are complete */
+void CRIR_M1_simulator::flush() {
+}
+
+
+#ifndef ARDUINO
+/* Receive request */
+void CRIR_M1_simulator::write(const uint8_t *data, uint8_t size) {
+    while (size--) {
+        write(*data++);
+    }
+}
+
+
+/* Sleep until next byte of answer, up to ms */
+void CRIR_M1_simulator::wait(unsigned long ms) {
+
+    unsigned long us = ms * 1000UL;
+    uint8_t n = arrived();
+
+    if (n < ans_len) {
+        long next = (long) (ans_start + n * CRIR_M1_SIM_BYTE_US - micros());
+        if (next <= 0) {
+            return;
+        }
+        if ((unsigned long) next < us) {
+            us = next;
+        }
+    }
+
+    struct timespec ts;
+    ts.tv_sec = us / 1000000UL;
+    ts.tv_nsec = (us % 1000000UL) * 1000UL;
+    nanosleep(&ts, NULL);
+}
+
+
+/* Time in milliseconds */
+unsigned long CRIR_M1_simulator::now_ms() {
+    return micros() / 1000UL;
+}
+#endif
+
+
+/* Bytes of answer received until now */
+uint8_t CRIR_M1_simulator::arrived() {
+
+    if (ans_len == 0) {
+        return 0;
+    }
+
+    long elapsed = (long) (micros() - ans_start);
+    if (elapsed < 0) {
+        return 0;
+    }
+
+    uint32_t n = elapsed / CRIR_M1_SIM_BYTE_US + 1;
+    if (n > ans_len) {
+        n = ans_len;
+    }
+
+    // Bytes not read in time are overwritten in FIFO
+    if (n - ans_read > fifo_len) {
+        lost += n - ans_read - fifo_len;
+        ans_read = n - fifo_len;
+    }
+
+    return n;
+}
+
+
+/* Process complete request */
+void CRIR_M1_simulator::answer() {
+
+    uint16_t crc16 = modbus_CRC16(req, 6);
+    uint16_t reg = (req[2] << 8) | req[3];
+    uint16_t value = (req[4] << 8) | req[5];
+
+    // New request discards old answer
+    ans_len = 0;
+    ans_read = 0;
+
+    if (req[0] != MODBUS_ANY_ADDRESS || req[6] != (crc16 & 0x00FF) || req[7] != ((crc16 >> 8) & 0x00FF)) {
+        return;
+    }
+
+    seed = seed * 1103515245UL + 12345UL;
+    if (((seed >> 16) % 100) < drop_rate) {
+        return;
+    }
+
+    if (req[1] == MODBUS_FUNC_READ_INPUT_REGISTERS || req[1] == MODBUS_FUNC_READ_HOLDING_REGISTERS) {
+        uint16_t *regs = (req[1] == MODBUS_FUNC_READ_INPUT_REGISTERS) ? input_reg : holding_reg;
+        uint16_t n_regs = (req[1] == MODBUS_FUNC_READ_INPUT_REGISTERS) ? CRIR_M1_SIM_N_INPUT_REG : CRIR_M1_SIM_N_HOLDING_REG;
+
+        if (value < 1 || reg + value > n_regs || 5 + 2 * value > CRIR_M1_LEN_BUF_MSG) {
+            return;
+        }
+        ans[0] = MODBUS_ANY_ADDRESS;
+        ans[1] = req[1];
+        ans[2] = 2 * value;
+        for (uint16_t i = 0; i < value; i++) {
+            ans[3 + 2 * i] = (regs[reg + i] >> 8) & 0x00FF;
+            ans[4 + 2 * i] = regs[reg + i] & 0x00FF;
+        }
+        ans_len = 3 + 2 * value;
+
+    } else if (req[1] == MODBUS_FUNC_PRESET_SINGLE_REGISTER) {
+        if (reg >= CRIR_M1_SIM_N_HOLDING_REG) {
+            return;
+        }
+        holding_reg[reg] = value;
+        memcpy(ans, req, 6);
+        ans_len = 6;
+
+    } else {
+        return;
+    }
+
+    crc16 = modbus_CRC16(ans, ans_len);
+    ans[ans_len++] = crc16 & 0x00FF;
+    ans[ans_len++] = (crc16 >> 8) & 0x00FF;
+
+    // Answer starts after request has been transmitted
+    ans_start = micros() + sizeof(req) * CRIR_M1_SIM_BYTE_US + delay_us;
+}
+
+#endif
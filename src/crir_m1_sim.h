@@ -0,0 +1,111 @@
+/*******************************************************************
+  CRIR M1 Library - Simulator
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Simulated CRIR M1 sensor in memory, to use instead of a serial port:
+
+CRIR_M1_simulator sim;
+CRIR_M1 sensor(sim);
+
+Answers are paced at 9600 baud (a byte is available every
+CRIR_M1_SIM_BYTE_US microseconds, after the request has been transmitted).
+Like a UART, only CRIR_M1_SIM_FIFO_LEN received bytes are kept (16, like a
+16550, or less with set_fifo_len()), bytes not read in time are lost
+(overrun).
+
+On Arduino the simulator is a Stream. On Linux and macOS it is a transport
+(see crir_m1_transport.h) with real time, so host programs can measure the
+library without a sensor:
+
+CRIR_M1T<CRIR_M1_simulator> sensor{CRIR_M1_simulator()};
+sensor.get_transport().set_co2(800);
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_SIM
+    #define _CRIR_M1_SIM
+
+    #include "crir_m1.h"
+
+    #if defined ARDUINO || defined CRIR_M1_POSIX
+
+    #define CRIR_M1_SIM_BYTE_US   (10000000UL / CRIR_M1_BAUDRATE)   // Time of one byte (8N1) in microseconds
+
+    #ifndef CRIR_M1_SIM_FIFO_LEN
+        #define CRIR_M1_SIM_FIFO_LEN  16                             // Max size of receive FIFO of simulated UART
+    #endif
+
+#ifdef ARDUINO
+    class CRIR_M1_simulator : public Stream
+#else
+    class CRIR_M1_simulator
+#endif
+    {
+        public:
+            CRIR_M1_simulator();                                                 // Initialize
+            void set_co2(int16_t co2);                                           // Set CO2 value in ppm
+            void set_temperature(int16_t temperature);                           // Set temperature in celsius degree
+            void set_meter_status(int16_t status);                               // Set meter status
+            void set_output_status(int16_t status);                              // Set output status
+            void set_sensor_ID(int32_t id);                                      // Set sensor ID
+            void set_response_delay(uint32_t us);                                // Time sensor needs to answer
+            void set_drop_rate(uint8_t percent);                                 // Requests without answer (percent)
+            void set_fifo_len(uint8_t len);                                      // Size of receive FIFO (1 - CRIR_M1_SIM_FIFO_LEN bytes)
+            uint32_t overruns();                                                 // Bytes lost because they were not read in time
+
+            int available();
+            int read();
+            int peek();
+            size_t write(uint8_t data);
+#ifdef ARDUINO
+            using Print::write;
+#else
+            void write(const uint8_t *data, uint8_t size);                       // Receive request (transport)
+            void wait(unsigned long ms);                                         // Sleep until next byte of answer (transport)
+            unsigned long now_ms();                                              // Time in milliseconds (transport)
+#endif
+            void flush();
+
+        private:
+            uint16_t input_reg[MODBUS_IR20 + 1];                                 // Input registers
+            uint16_t holding_reg[MODBUS_HR8 + 1];                                // Holding registers
+            uint8_t req[8];                                                      // Received request
+            uint8_t req_len;                                                     // Bytes of received request
+            uint8_t ans[CRIR_M1_LEN_BUF_MSG];                                    // Answer
+            uint8_t ans_len;                                                     // Length of answer
+            uint8_t ans_read;                                                    // Bytes of answer read or lost
+            unsigned long ans_start;                                             // Time when first byte of answer is available (us)
+            uint32_t delay_us;                                                   // Time sensor needs to answer
+            uint8_t drop_rate;                                                   // Requests without answer (percent)
+            uint8_t fifo_len;                                                    // Size of receive FIFO
+            uint32_t seed;                                                       // Random generator state
+            uint32_t lost;                                                       // Bytes lost
+
+            uint8_t arrived();                                                   // Bytes of answer received until now
+            void answer();                                                       // Process complete request
+    };
+
+    #endif
+
+#endif
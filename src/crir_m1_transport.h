@@ -0,0 +1,270 @@
+/*******************************************************************
+  CRIR M1 Library - Transports
+
+Copyright (c) 2021 Josep Comas
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+Transports used by CRIR_M1T<Transport> to talk with the sensor. Calls are
+resolved at compile time, so a transport only needs these members:
+
+    int available();                                  // Bytes ready to read
+    int read();                                       // Read one byte (-1 if none)
+    void write(const uint8_t *data, uint8_t size);    // Send bytes
+    void flush();                                     // Wait until bytes are sent
+    void wait(unsigned long ms);                      // Wait up to ms for a byte to read (may return before)
+    unsigned long now_ms();                           // Time in milliseconds
+
+CRIR_M1_stream_transport    -> Arduino Stream (CRIR_M1 is CRIR_M1T<CRIR_M1_stream_transport>)
+CRIR_M1_fd_transport        -> POSIX file descriptor (Linux, macOS)
+CRIR_M1_buffer_transport    -> Memory buffers, for tests
+CRIR_M1_avr_uart_transport  -> UART0 registers of AVR, without HardwareSerial
+
+*******************************************************************/
+
+
+#ifndef _CRIR_M1_TRANSPORT
+    #define _CRIR_M1_TRANSPORT
+
+    #ifdef ARDUINO
+        #include "Arduino.h"
+    #else
+        #include <stdint.h>
+        #include <string.h>
+    #endif
+
+    #if !defined ARDUINO && (defined __unix__ || defined __APPLE__)
+        #define CRIR_M1_POSIX
+        #include <fcntl.h>
+        #include <poll.h>
+        #include <termios.h>
+        #include <time.h>
+        #include <unistd.h>
+        #include <sys/ioctl.h>
+    #endif
+
+    #ifndef CRIR_M1_BUFFER_TRANSPORT_LEN
+        #define CRIR_M1_BUFFER_TRANSPORT_LEN  64     // Size of each buffer of CRIR_M1_buffer_transport
+    #endif
+
+
+    #ifdef ARDUINO
+    // Arduino Stream (HardwareSerial, SoftwareSerial...)
+    class CRIR_M1_stream_transport
+    {
+        public:
+            CRIR_M1_stream_transport(Stream &serial) : serial(&serial) {}
+
+            int available() { return serial->available(); }
+            int read() { return serial->read(); }
+            void write(const uint8_t *data, uint8_t size) { serial->write(data, size); }
+            void flush() { serial->flush(); }
+            void wait(unsigned long ms) { (void) ms; yield(); }
+            unsigned long now_ms() { return millis(); }
+
+        private:
+            Stream *serial;                                                      // Communication serial with the sensor
+    };
+    #endif
+
+
+    #ifdef CRIR_M1_POSIX
+    // POSIX file descriptor of a serial port, bytes are read in blocks
+    class CRIR_M1_fd_transport
+    {
+        public:
+            CRIR_M1_fd_transport(int fd) : fd(fd), pos(0), len(0) {}
+
+            /* Open and configure serial port at 9600 8N1, returns file descriptor or -1 */
+            static int open_port(const char *device) {
+                int fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+                if (fd < 0) {
+                    return -1;
+                }
+
+                struct termios tty;
+                if (tcgetattr(fd, &tty) != 0) {
+                    ::close(fd);
+                    return -1;
+                }
+                cfmakeraw(&tty);
+                cfsetispeed(&tty, B9600);
+                cfsetospeed(&tty, B9600);
+                tty.c_cflag |= CLOCAL | CREAD;
+                tty.c_cflag &= ~(CSTOPB | PARENB);
+                tty.c_cc[VMIN] = 0;
+                tty.c_cc[VTIME] = 0;
+                if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+                    ::close(fd);
+                    return -1;
+                }
+                return fd;
+            }
+
+            int available() {
+                if (pos == len) {
+                    fill();
+                }
+                return len - pos;
+            }
+
+            int read() {
+                if (pos == len && fill() == 0) {
+                    return -1;
+                }
+                return buf[pos++];
+            }
+
+            void write(const uint8_t *data, uint8_t size) {
+                while (size > 0) {
+                    ssize_t n = ::write(fd, data, size);
+                    if (n <= 0) {
+                        return;
+                    }
+                    data += n;
+                    size -= n;
+                }
+            }
+
+            void flush() { tcdrain(fd); }
+
+            /* Sleep until a byte arrives or ms elapses, so waiting answers does not use CPU */
+            void wait(unsigned long ms) {
+                if (pos < len) {
+                    return;
+                }
+                struct pollfd p;
+                p.fd = fd;
+                p.events = POLLIN;
+                p.revents = 0;
+                ::poll(&p, 1, (ms > 60000UL) ? 60000 : (int) ms);
+            }
+
+            unsigned long now_ms() {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+            }
+
+        private:
+            int fd;                                                              // File descriptor of serial port
+            uint8_t buf[32];                                                     // Bytes read from port
+            uint8_t pos;                                                         // Next byte to return
+            uint8_t len;                                                         // Bytes in buffer
+
+            uint8_t fill() {                                                     // Read available bytes without blocking
+                ssize_t n = ::read(fd, buf, sizeof(buf));
+                pos = 0;
+                len = (n > 0) ? n : 0;
+                return len;
+            }
+    };
+    #endif
+
+
+    // Memory buffers, bytes to read are given with feed() and sent bytes are saved.
+    // Time advances 1 ms each time it is read, so timeouts finish without waiting.
+    class CRIR_M1_buffer_transport
+    {
+        public:
+            CRIR_M1_buffer_transport() : rx_pos(0), rx_len(0), tx_len(0), ms(0) {}
+
+            /* Add bytes to read */
+            bool feed(const uint8_t *data, uint8_t size) {
+                if (rx_pos == rx_len) {
+                    rx_pos = rx_len = 0;
+                }
+                if (size > CRIR_M1_BUFFER_TRANSPORT_LEN - rx_len) {
+                    return false;
+                }
+                memcpy(&rx[rx_len], data, size);
+                rx_len += size;
+                return true;
+            }
+
+            const uint8_t *sent() { return tx; }                                 // Bytes sent
+            uint8_t sent_len() { return tx_len; }                                // Number of bytes sent
+            void clear_sent() { tx_len = 0; }                                    // Forget bytes sent
+
+            int available() { return rx_len - rx_pos; }
+            int read() { return (rx_pos < rx_len) ? rx[rx_pos++] : -1; }
+
+            void write(const uint8_t *data, uint8_t size) {
+                if (size > CRIR_M1_BUFFER_TRANSPORT_LEN - tx_len) {
+                    size = CRIR_M1_BUFFER_TRANSPORT_LEN - tx_len;
+                }
+                memcpy(&tx[tx_len], data, size);
+                tx_len += size;
+            }
+
+            void flush() {}
+            void wait(unsigned long ms) { (void) ms; }
+            unsigned long now_ms() { return ms++; }
+
+        private:
+            uint8_t rx[CRIR_M1_BUFFER_TRANSPORT_LEN];                            // Bytes to read
+            uint8_t rx_pos;                                                      // Next byte to read
+            uint8_t rx_len;                                                      // Bytes in rx
+            uint8_t tx[CRIR_M1_BUFFER_TRANSPORT_LEN];                            // Bytes sent
+            uint8_t tx_len;                                                      // Bytes in tx
+            unsigned long ms;                                                    // Simulated time
+    };
+
+
+    #if defined __AVR__ && defined UDR0
+    // UART0 registers of AVR (pins 0 and 1 of Arduino UNO), Serial must not be used.
+    // UART has one byte of buffer, so answers must be read while they arrive (blocking getters).
+    class CRIR_M1_avr_uart_transport
+    {
+        public:
+            CRIR_M1_avr_uart_transport() {}
+
+            /* Setup UART at 9600 8N1 */
+            static void begin() {
+                uint16_t ubrr = (F_CPU / 8 / 9600) - 1;
+                UCSR0A = _BV(U2X0);
+                UBRR0H = ubrr >> 8;
+                UBRR0L = ubrr & 0xFF;
+                UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+                UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+            }
+
+            int available() { return (UCSR0A & _BV(RXC0)) ? 1 : 0; }
+            int read() { return (UCSR0A & _BV(RXC0)) ? UDR0 : -1; }
+
+            void write(const uint8_t *data, uint8_t size) {
+                while (size--) {
+                    while (!(UCSR0A & _BV(UDRE0))) {}
+                    UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0);                   // Clear transmit complete flag (FE0, DOR0 and UPE0 must be written as 0)
+                    UDR0 = *data++;
+                }
+            }
+
+            void flush() {
+                while ((UCSR0B & _BV(TXEN0)) && !(UCSR0A & _BV(TXC0))) {}
+            }
+
+            void wait(unsigned long ms) { (void) ms; }
+
+            unsigned long now_ms() { return millis(); }
+    };
+    #endif
+
+#endif